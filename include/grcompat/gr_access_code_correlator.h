@@ -0,0 +1,246 @@
+//Somewhere in this noise is a word we know
+
+#ifndef GNURADIO_GR_ACCESS_CODE_CORRELATOR_H
+#define GNURADIO_GR_ACCESS_CODE_CORRELATOR_H
+
+#include <gr_count_bits.h>
+#include <gnuradio/endianness.h>
+#include <boost/cstdint.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+//! One access code found by gr_access_code_correlator
+struct gr_access_code_match
+{
+    boost::uint64_t offset; //!< stream index of the first bit of the code; the payload starts at offset + length
+    size_t code; //!< index of the code, in the order it was added
+    unsigned length; //!< code length in bits
+    unsigned errors; //!< bits that differ from the code
+};
+
+/*!
+ * \brief Finds access codes in a bit stream, allowing bit errors.
+ *
+ * Replaces the shift-register-and-popcount loop of the legacy
+ * deframers.  Up to 128-bit codes, each with its own Hamming
+ * threshold, are searched in one pass, and every offset at which a
+ * code matches is reported (overlapping matches included).  Streams
+ * are fed in pieces of any size, as unpacked bits (one per byte, in
+ * the LSB, the usual GNU Radio convention) or packed bytes; offsets
+ * count bits from the start of the stream.
+ *
+ * The search is bit sliced: for 64 candidate offsets at a time, the
+ * mismatches against each code bit are one XOR, and are added into
+ * vertical counters preset so that they overflow exactly when a
+ * position exceeds the threshold.  Once every position in the block
+ * has overflowed the rest of the code is skipped, so on noise a
+ * block of 64 offsets usually costs a few dozen word operations.
+ */
+class gr_access_code_correlator
+{
+public:
+    gr_access_code_correlator(void):
+        d_base(0),
+        d_end(0)
+    {
+        d_words.push_back(0);
+    }
+
+    /*!
+     * Add a code of \p length bits (1..64) whose first bit on the air
+     * is bit length-1 of \p code; return its index.
+     */
+    size_t add_code(boost::uint64_t code, unsigned length, unsigned threshold)
+    {
+        if (length == 0 or length > 64) throw std::invalid_argument("gr_access_code_correlator: code length must be 1..64 bits");
+        std::string bits;
+        for (unsigned i = 0; i < length; i++) bits.push_back(((code >> (length - 1 - i)) & 1)? '1' : '0');
+        return add_code(bits, threshold);
+    }
+
+    //! Add a code given as a string of '0' and '1' (1..128 bits, first bit first); return its index
+    size_t add_code(const std::string &bits, unsigned threshold)
+    {
+        if (bits.empty() or bits.size() > 128) throw std::invalid_argument("gr_access_code_correlator: code length must be 1..128 bits");
+        code_t c;
+        c.length = unsigned(bits.size());
+        c.threshold = std::min(threshold, c.length);
+        c.next = d_end;
+        for (size_t i = 0; i < bits.size(); i++)
+        {
+            if (bits[i] != '0' and bits[i] != '1') throw std::invalid_argument("gr_access_code_correlator: code must be a string of 0 and 1");
+            c.mask.push_back((bits[i] == '1')? ~boost::uint64_t(0) : 0);
+            if (i%64 == 0) c.words.push_back(0);
+            if (bits[i] == '1') c.words.back() |= boost::uint64_t(1) << (i%64);
+        }
+        //counters start at 2^planes - 1 - threshold so that they carry out at threshold + 1
+        c.planes = 1;
+        while ((1u << c.planes) <= c.threshold + 1) c.planes++;
+        c.preset = (1u << c.planes) - 1 - c.threshold;
+        d_codes.push_back(c);
+        return d_codes.size() - 1;
+    }
+
+    //! Forget the stream (the codes are kept); offsets restart at zero
+    void reset(void)
+    {
+        d_words.assign(1, 0);
+        d_base = d_end = 0;
+        for (size_t i = 0; i < d_codes.size(); i++) d_codes[i].next = 0;
+    }
+
+    //! Feed \p n unpacked bits and append the matches they complete to \p matches
+    void process_bits(const unsigned char *bits, size_t n, std::vector<gr_access_code_match> &matches)
+    {
+        reserve_bits(n);
+        for (size_t i = 0; i < n; i++, d_end++)
+        {
+            const boost::uint64_t local = d_end - d_base;
+            d_words[local/64] |= boost::uint64_t(bits[i] & 1) << (local%64);
+        }
+        search(matches);
+    }
+
+    //! Feed \p nbytes packed bytes and append the matches they complete to \p matches
+    void process_packed(const unsigned char *bytes, size_t nbytes, std::vector<gr_access_code_match> &matches,
+        gr::endianness_t order = gr::GR_MSB_FIRST)
+    {
+        reserve_bits(8*nbytes);
+        for (size_t i = 0; i < nbytes; i += 8)
+        {
+            //eight bytes at a time; stream order is LSB first within the words
+            const size_t n = std::min<size_t>(8, nbytes - i);
+            boost::uint64_t w = 0;
+            for (size_t k = 0; k < n; k++) w |= boost::uint64_t(bytes[i + k]) << (8*k);
+            if (order == gr::GR_MSB_FIRST) w = reverse_bytes_bits(w);
+            const boost::uint64_t local = d_end - d_base;
+            d_words[local/64] |= w << (local%64);
+            if (local%64 != 0) d_words[local/64 + 1] |= w >> (64 - local%64);
+            d_end += 8*n;
+        }
+        search(matches);
+    }
+
+    //! Number of codes
+    size_t num_codes(void) const
+    {
+        return d_codes.size();
+    }
+
+private:
+    struct code_t
+    {
+        std::vector<boost::uint64_t> mask; //!< all ones or all zeros per code bit
+        std::vector<boost::uint64_t> words; //!< the code packed in stream order, LSB first
+        unsigned length, threshold, planes, preset;
+        boost::uint64_t next; //!< first offset not yet searched
+    };
+
+    //! Reverse the bit order within each byte of \p w
+    static boost::uint64_t reverse_bytes_bits(boost::uint64_t w)
+    {
+        w = ((w >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((w & 0x0f0f0f0f0f0f0f0fULL) << 4);
+        w = ((w >> 2) & 0x3333333333333333ULL) | ((w & 0x3333333333333333ULL) << 2);
+        w = ((w >> 1) & 0x5555555555555555ULL) | ((w & 0x5555555555555555ULL) << 1);
+        return w;
+    }
+
+    //! Make room for \p n more bits, keeping a zero word past the end
+    void reserve_bits(size_t n)
+    {
+        const size_t words = size_t((d_end + n - d_base)/64) + 2;
+        if (d_words.size() < words) d_words.resize(words, 0);
+    }
+
+    //! The 64 stream bits starting at absolute bit \p s (bit q of the result is bit s + q)
+    boost::uint64_t extract(boost::uint64_t s) const
+    {
+        const boost::uint64_t local = s - d_base;
+        const size_t w = size_t(local/64);
+        const unsigned shift = unsigned(local%64);
+        if (shift == 0) return d_words[w];
+        return (d_words[w] >> shift) | (d_words[w + 1] << (64 - shift));
+    }
+
+    void search(std::vector<gr_access_code_match> &matches)
+    {
+        for (size_t ci = 0; ci < d_codes.size(); ci++)
+        {
+            code_t &c = d_codes[ci];
+            while (c.next + c.length <= d_end)
+            {
+                const boost::uint64_t count = std::min<boost::uint64_t>(64, d_end - c.length + 1 - c.next);
+                boost::uint64_t alive = (count == 64)? ~boost::uint64_t(0) : ((boost::uint64_t(1) << count) - 1);
+                alive &= search_block(c, c.next);
+                while (alive)
+                {
+                    const unsigned q = gr_count_bits64((alive & -alive) - 1);
+                    alive &= alive - 1;
+                    gr_access_code_match m;
+                    m.offset = c.next + q;
+                    m.code = ci;
+                    m.length = c.length;
+                    m.errors = errors_at(c, m.offset);
+                    if (m.errors <= c.threshold) matches.push_back(m);
+                }
+                c.next += count;
+            }
+        }
+        discard_consumed();
+    }
+
+    //! Mask of the 64 offsets from \p p that may match code \p c (a superset of the matches)
+    boost::uint64_t search_block(const code_t &c, boost::uint64_t p) const
+    {
+        boost::uint64_t plane[8];
+        for (unsigned b = 0; b < c.planes; b++) plane[b] = ((c.preset >> b) & 1)? ~boost::uint64_t(0) : 0;
+        boost::uint64_t dead = 0;
+        for (unsigned j = 0; j < c.length; j++)
+        {
+            boost::uint64_t carry = (extract(p + j) ^ c.mask[j]) & ~dead;
+            for (unsigned b = 0; b < c.planes; b++)
+            {
+                const boost::uint64_t sum = plane[b] ^ carry;
+                carry &= plane[b];
+                plane[b] = sum;
+            }
+            dead |= carry;
+            //once only a few positions survive, checking them one by one is cheaper
+            if (j%8 == 7 and gr_count_bits64(~dead) <= 4) break;
+        }
+        return ~dead;
+    }
+
+    unsigned errors_at(const code_t &c, boost::uint64_t p) const
+    {
+        unsigned errors = 0;
+        for (unsigned j = 0; j < c.length; j += 64)
+        {
+            const unsigned n = std::min(64u, c.length - j);
+            boost::uint64_t diff = extract(p + j) ^ c.words[j/64];
+            if (n < 64) diff &= (boost::uint64_t(1) << n) - 1;
+            errors += gr_count_bits64(diff);
+        }
+        return errors;
+    }
+
+    //! Drop whole words that every code has searched past
+    void discard_consumed(void)
+    {
+        boost::uint64_t keep = d_end;
+        for (size_t i = 0; i < d_codes.size(); i++) keep = std::min(keep, d_codes[i].next);
+        const size_t drop = size_t((keep - d_base)/64);
+        if (drop == 0) return;
+        d_words.erase(d_words.begin(), d_words.begin() + drop);
+        d_base += 64*drop;
+    }
+
+    std::vector<code_t> d_codes;
+    std::vector<boost::uint64_t> d_words;
+    boost::uint64_t d_base; //!< absolute index of bit 0 of d_words[0]
+    boost::uint64_t d_end; //!< absolute index one past the last bit fed
+};
+
+#endif //GNURADIO_GR_ACCESS_CODE_CORRELATOR_H
@@ -3,8 +3,14 @@
 #ifndef GNURADIO_GR_COUNT_BITS_H
 #define GNURADIO_GR_COUNT_BITS_H
 
+#include <gr_cpu.h>
+#include <boost/cstdint.hpp>
+#include <cstring>
+#include <cstddef>
+
 #if __GNUC__ > 3 || __GNUC__ == 3 && __GNUC_MINOR__ >= 4
     #define __grjhsfhjspopcnt __builtin_popcount
+    #define __grjhsfhjspopcntll __builtin_popcountll
 #else
     inline unsigned __grjhsfhjspopcnt(unsigned num)
     {
@@ -16,6 +22,10 @@
         }
         return pop;
     }
+    inline unsigned __grjhsfhjspopcntll(unsigned long long num)
+    {
+        return __grjhsfhjspopcnt(unsigned(num & 0xffffffff)) + __grjhsfhjspopcnt(unsigned(num >> 32));
+    }
 #endif
 
 static inline unsigned int gr_count_bits8(unsigned int x)
@@ -32,10 +42,355 @@ static inline unsigned int gr_count_bits32(unsigned int x)
 }
 static inline unsigned int gr_count_bits64(unsigned long long int x)
 {
-    return gr_count_bits32(x & 0xffffffff) + gr_count_bits32(x >> 32);
+    return __grjhsfhjspopcntll(x);
+}
+
+/***********************************************************************
+ * Buffer kernels
+ **********************************************************************/
+namespace gr_count_bits_detail
+{
+    typedef boost::uint64_t u64;
+
+    //! Branch-free popcount that needs no popcnt instruction
+    inline u64 swar_popcount64(u64 x)
+    {
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return (x*0x0101010101010101ULL) >> 56;
+    }
+
+    //! Reads the bits of one buffer
+    struct load_one
+    {
+        explicit load_one(const void *a): a(static_cast<const unsigned char *>(a)){}
+        u64 word(size_t off) const {u64 w; std::memcpy(&w, a + off, 8); return w;}
+        unsigned byte(size_t off) const {return a[off];}
+        #ifdef GR_CPU_X86
+        GR_CPU_TARGET("avx2") __m256i vec(size_t off) const
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + off));
+        }
+        GR_CPU_TARGET("avx512f") __m512i vec512(size_t off) const
+        {
+            return _mm512_loadu_si512(a + off);
+        }
+        #endif
+        const unsigned char *a;
+    };
+
+    //! Reads the XOR of two buffers, for Hamming distance
+    struct load_xor
+    {
+        load_xor(const void *a, const void *b): a(static_cast<const unsigned char *>(a)), b(static_cast<const unsigned char *>(b)){}
+        u64 word(size_t off) const {u64 x, y; std::memcpy(&x, a + off, 8); std::memcpy(&y, b + off, 8); return x ^ y;}
+        unsigned byte(size_t off) const {return a[off] ^ b[off];}
+        #ifdef GR_CPU_X86
+        GR_CPU_TARGET("avx2") __m256i vec(size_t off) const
+        {
+            return _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + off)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + off)));
+        }
+        GR_CPU_TARGET("avx512f") __m512i vec512(size_t off) const
+        {
+            return _mm512_xor_si512(_mm512_loadu_si512(a + off), _mm512_loadu_si512(b + off));
+        }
+        #endif
+        const unsigned char *a, *b;
+    };
+
+    //! Carry-save adder: add three bit vectors into sum bits \p l and carry bits \p h
+    inline void csa(u64 &h, u64 &l, u64 a, u64 b, u64 c)
+    {
+        const u64 u = a ^ b;
+        h = (a & b) | (u & c);
+        l = u ^ c;
+    }
+
+    //! Count bytes [begin, n) a word at a time with swar_popcount64
+    template <typename Load>
+    u64 count_swar(const Load &in, size_t begin, size_t n)
+    {
+        u64 total = 0;
+        size_t i = begin;
+        for (; i + 8 <= n; i += 8) total += swar_popcount64(in.word(i));
+        for (; i < n; i++) total += swar_popcount64(in.byte(i));
+        return total;
+    }
+
+    /*!
+     * Harley-Seal: a tree of carry-save adders folds 16 words into
+     * one, so only one popcount is needed per 128 bytes.  This is
+     * the fallback for CPUs without a popcnt instruction.
+     */
+    template <typename Load>
+    u64 count_harley_seal(const Load &in, size_t n)
+    {
+        u64 total = 0, ones = 0, twos = 0, fours = 0, eights = 0, sixteens;
+        u64 twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+        size_t i = 0;
+        for (; i + 128 <= n; i += 128)
+        {
+            csa(twos_a, ones, ones, in.word(i + 0), in.word(i + 8));
+            csa(twos_b, ones, ones, in.word(i + 16), in.word(i + 24));
+            csa(fours_a, twos, twos, twos_a, twos_b);
+            csa(twos_a, ones, ones, in.word(i + 32), in.word(i + 40));
+            csa(twos_b, ones, ones, in.word(i + 48), in.word(i + 56));
+            csa(fours_b, twos, twos, twos_a, twos_b);
+            csa(eights_a, fours, fours, fours_a, fours_b);
+            csa(twos_a, ones, ones, in.word(i + 64), in.word(i + 72));
+            csa(twos_b, ones, ones, in.word(i + 80), in.word(i + 88));
+            csa(fours_a, twos, twos, twos_a, twos_b);
+            csa(twos_a, ones, ones, in.word(i + 96), in.word(i + 104));
+            csa(twos_b, ones, ones, in.word(i + 112), in.word(i + 120));
+            csa(fours_b, twos, twos, twos_a, twos_b);
+            csa(eights_b, fours, fours, fours_a, fours_b);
+            csa(sixteens, eights, eights, eights_a, eights_b);
+            total += swar_popcount64(sixteens);
+        }
+        total = 16*total + 8*swar_popcount64(eights) + 4*swar_popcount64(fours)
+            + 2*swar_popcount64(twos) + swar_popcount64(ones);
+        return total + count_swar(in, i, n);
+    }
+
+    #ifdef GR_CPU_X86
+
+    //! One hardware popcnt per word, four independent accumulators
+    template <typename Load>
+    GR_CPU_TARGET("popcnt") u64 count_popcnt(const Load &in, size_t n)
+    {
+        u64 c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            c0 += __builtin_popcountll(in.word(i + 0));
+            c1 += __builtin_popcountll(in.word(i + 8));
+            c2 += __builtin_popcountll(in.word(i + 16));
+            c3 += __builtin_popcountll(in.word(i + 24));
+        }
+        for (; i + 8 <= n; i += 8) c0 += __builtin_popcountll(in.word(i));
+        for (; i < n; i++) c0 += __builtin_popcount(in.byte(i));
+        return c0 + c1 + c2 + c3;
+    }
+
+    //! Per-byte counts of a vector: two 16-entry nibble table lookups with vpshufb
+    GR_CPU_TARGET("avx2") inline __m256i avx2_byte_counts(__m256i v)
+    {
+        const __m256i table = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        const __m256i lo = _mm256_and_si256(v, low);
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+        return _mm256_add_epi8(_mm256_shuffle_epi8(table, lo), _mm256_shuffle_epi8(table, hi));
+    }
+
+    //! Popcount of each 64-bit lane
+    GR_CPU_TARGET("avx2") inline __m256i avx2_popcount256(__m256i v)
+    {
+        return _mm256_sad_epu8(avx2_byte_counts(v), _mm256_setzero_si256());
+    }
+
+    GR_CPU_TARGET("avx2") inline void avx2_csa(__m256i &h, __m256i &l, __m256i a, __m256i b, __m256i c)
+    {
+        const __m256i u = _mm256_xor_si256(a, b);
+        h = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+        l = _mm256_xor_si256(u, c);
+    }
+
+    GR_CPU_TARGET("avx2") inline u64 avx2_hsum(__m256i v)
+    {
+        u64 lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), v);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    /*!
+     * AVX2: Harley-Seal over 512-byte blocks, with the nibble-lookup
+     * popcount for the carry-save outputs; then the nibble lookup
+     * alone for the remaining vectors, and popcnt for the tail.
+     */
+    template <typename Load>
+    GR_CPU_TARGET("avx2,popcnt") u64 count_avx2(const Load &in, size_t n)
+    {
+        __m256i total = _mm256_setzero_si256();
+        __m256i ones = _mm256_setzero_si256(), twos = ones, fours = ones, eights = ones, sixteens;
+        __m256i twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+        size_t i = 0;
+        for (; i + 512 <= n; i += 512)
+        {
+            avx2_csa(twos_a, ones, ones, in.vec(i + 0*32), in.vec(i + 1*32));
+            avx2_csa(twos_b, ones, ones, in.vec(i + 2*32), in.vec(i + 3*32));
+            avx2_csa(fours_a, twos, twos, twos_a, twos_b);
+            avx2_csa(twos_a, ones, ones, in.vec(i + 4*32), in.vec(i + 5*32));
+            avx2_csa(twos_b, ones, ones, in.vec(i + 6*32), in.vec(i + 7*32));
+            avx2_csa(fours_b, twos, twos, twos_a, twos_b);
+            avx2_csa(eights_a, fours, fours, fours_a, fours_b);
+            avx2_csa(twos_a, ones, ones, in.vec(i + 8*32), in.vec(i + 9*32));
+            avx2_csa(twos_b, ones, ones, in.vec(i + 10*32), in.vec(i + 11*32));
+            avx2_csa(fours_a, twos, twos, twos_a, twos_b);
+            avx2_csa(twos_a, ones, ones, in.vec(i + 12*32), in.vec(i + 13*32));
+            avx2_csa(twos_b, ones, ones, in.vec(i + 14*32), in.vec(i + 15*32));
+            avx2_csa(fours_b, twos, twos, twos_a, twos_b);
+            avx2_csa(eights_b, fours, fours, fours_a, fours_b);
+            avx2_csa(sixteens, eights, eights, eights_a, eights_b);
+            total = _mm256_add_epi64(total, avx2_popcount256(sixteens));
+        }
+        total = _mm256_slli_epi64(total, 4);
+        total = _mm256_add_epi64(total, _mm256_slli_epi64(avx2_popcount256(eights), 3));
+        total = _mm256_add_epi64(total, _mm256_slli_epi64(avx2_popcount256(fours), 2));
+        total = _mm256_add_epi64(total, _mm256_slli_epi64(avx2_popcount256(twos), 1));
+        total = _mm256_add_epi64(total, avx2_popcount256(ones));
+
+        for (; i + 32 <= n; i += 32)
+        {
+            total = _mm256_add_epi64(total, avx2_popcount256(in.vec(i)));
+        }
+
+        u64 count = avx2_hsum(total);
+        for (; i + 8 <= n; i += 8) count += __builtin_popcountll(in.word(i));
+        for (; i < n; i++) count += __builtin_popcount(in.byte(i));
+        return count;
+    }
+
+    //! Per-64-bit-lane popcount with the AVX-512BW nibble lookup
+    GR_CPU_TARGET("avx512f,avx512bw") inline __m512i avx512_popcount512(__m512i v)
+    {
+        //bytes 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 in every 128-bit lane
+        const long long lo8 = 0x0302020102010100LL, hi8 = 0x0403030203020201LL;
+        const __m512i table = _mm512_set_epi64(hi8, lo8, hi8, lo8, hi8, lo8, hi8, lo8);
+        const __m512i low = _mm512_set1_epi8(0x0f);
+        const __m512i lo = _mm512_and_si512(v, low);
+        const __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), low);
+        const __m512i bytes = _mm512_add_epi8(_mm512_shuffle_epi8(table, lo), _mm512_shuffle_epi8(table, hi));
+        return _mm512_sad_epu8(bytes, _mm512_setzero_si512());
+    }
+
+    //! Carry-save adder as two ternary-logic ops (majority and three-way XOR)
+    GR_CPU_TARGET("avx512f") inline void avx512_csa(__m512i &h, __m512i &l, __m512i a, __m512i b, __m512i c)
+    {
+        h = _mm512_ternarylogic_epi64(a, b, c, 0xe8);
+        l = _mm512_ternarylogic_epi64(a, b, c, 0x96);
+    }
+
+    //! AVX-512: the AVX2 kernel with 64-byte vectors, Harley-Seal over 1024-byte blocks
+    template <typename Load>
+    GR_CPU_TARGET("avx512f,avx512bw,popcnt") u64 count_avx512(const Load &in, size_t n)
+    {
+        __m512i total = _mm512_setzero_si512();
+        __m512i ones = _mm512_setzero_si512(), twos = ones, fours = ones, eights = ones, sixteens;
+        __m512i twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+        size_t i = 0;
+        for (; i + 1024 <= n; i += 1024)
+        {
+            avx512_csa(twos_a, ones, ones, in.vec512(i + 0*64), in.vec512(i + 1*64));
+            avx512_csa(twos_b, ones, ones, in.vec512(i + 2*64), in.vec512(i + 3*64));
+            avx512_csa(fours_a, twos, twos, twos_a, twos_b);
+            avx512_csa(twos_a, ones, ones, in.vec512(i + 4*64), in.vec512(i + 5*64));
+            avx512_csa(twos_b, ones, ones, in.vec512(i + 6*64), in.vec512(i + 7*64));
+            avx512_csa(fours_b, twos, twos, twos_a, twos_b);
+            avx512_csa(eights_a, fours, fours, fours_a, fours_b);
+            avx512_csa(twos_a, ones, ones, in.vec512(i + 8*64), in.vec512(i + 9*64));
+            avx512_csa(twos_b, ones, ones, in.vec512(i + 10*64), in.vec512(i + 11*64));
+            avx512_csa(fours_a, twos, twos, twos_a, twos_b);
+            avx512_csa(twos_a, ones, ones, in.vec512(i + 12*64), in.vec512(i + 13*64));
+            avx512_csa(twos_b, ones, ones, in.vec512(i + 14*64), in.vec512(i + 15*64));
+            avx512_csa(fours_b, twos, twos, twos_a, twos_b);
+            avx512_csa(eights_b, fours, fours, fours_a, fours_b);
+            avx512_csa(sixteens, eights, eights, eights_a, eights_b);
+            total = _mm512_add_epi64(total, avx512_popcount512(sixteens));
+        }
+        //the maskz shifts avoid a GCC 12 -Wuninitialized false positive in the plain form
+        total = _mm512_maskz_slli_epi64(0xff, total, 4);
+        total = _mm512_add_epi64(total, _mm512_maskz_slli_epi64(0xff, avx512_popcount512(eights), 3));
+        total = _mm512_add_epi64(total, _mm512_maskz_slli_epi64(0xff, avx512_popcount512(fours), 2));
+        total = _mm512_add_epi64(total, _mm512_maskz_slli_epi64(0xff, avx512_popcount512(twos), 1));
+        total = _mm512_add_epi64(total, avx512_popcount512(ones));
+
+        for (; i + 64 <= n; i += 64)
+        {
+            total = _mm512_add_epi64(total, avx512_popcount512(in.vec512(i)));
+        }
+
+        u64 lanes[8];
+        _mm512_storeu_si512(lanes, total);
+        u64 count = 0;
+        for (size_t k = 0; k < 8; k++) count += lanes[k];
+        for (; i + 8 <= n; i += 8) count += __builtin_popcountll(in.word(i));
+        for (; i < n; i++) count += __builtin_popcount(in.byte(i));
+        return count;
+    }
+
+    #endif //GR_CPU_X86
+
+    //! Kernel choice for a loader, made once on first use
+    template <typename Load>
+    struct dispatch
+    {
+        typedef u64 (*kernel_t)(const Load &, size_t);
+
+        static kernel_t select(const char **name)
+        {
+            #ifdef GR_CPU_X86
+            if (gr_cpu::level() >= GR_CPU_AVX512)
+            {
+                *name = "avx512";
+                return &count_avx512<Load>;
+            }
+            if (gr_cpu::level() >= GR_CPU_AVX2)
+            {
+                *name = "avx2";
+                return &count_avx2<Load>;
+            }
+            if (gr_cpu::level() >= GR_CPU_SSE42)
+            {
+                *name = "popcnt";
+                return &count_popcnt<Load>;
+            }
+            #endif
+            *name = "harley_seal";
+            return &count_harley_seal<Load>;
+        }
+
+        static const char *&name(void)
+        {
+            static const char *n = "";
+            return n;
+        }
+
+        static kernel_t kernel(void)
+        {
+            static const kernel_t k = select(&name());
+            return k;
+        }
+    };
+
+} //namespace gr_count_bits_detail
+
+//! Count the set bits in \p nbytes bytes at \p buf
+static inline boost::uint64_t gr_count_bits_buffer(const void *buf, size_t nbytes)
+{
+    using namespace gr_count_bits_detail;
+    return dispatch<load_one>::kernel()(load_one(buf), nbytes);
+}
+
+//! Count the bits that differ between \p nbytes bytes at \p a and at \p b
+static inline boost::uint64_t gr_hamming_distance(const void *a, const void *b, size_t nbytes)
+{
+    using namespace gr_count_bits_detail;
+    return dispatch<load_xor>::kernel()(load_xor(a, b), nbytes);
+}
+
+//! Name of the buffer kernel picked for this CPU ("avx512", "avx2", "popcnt" or "harley_seal")
+static inline const char *gr_count_bits_buffer_kernel(void)
+{
+    using namespace gr_count_bits_detail;
+    dispatch<load_one>::kernel();
+    return dispatch<load_one>::name();
 }
 
 #endif //GNURADIO_GR_COUNT_BITS_H
 
 #warning GR-COMPAT REQUIRED TO COMPILE - OUTDATED GNURADIO API IN USE - PLEASE UPDATE YOUR MODULE!!!
-
@@ -0,0 +1,197 @@
+//Know thy silicon
+
+#ifndef GNURADIO_GR_CPU_H
+#define GNURADIO_GR_CPU_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+//x86 kernels are compiled with per-function target attributes and chosen at runtime
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define GR_CPU_X86
+    #include <immintrin.h>
+    #include <cpuid.h>
+    #define GR_CPU_TARGET(x) __attribute__((target(x)))
+#endif
+
+/*!
+ * Instruction set levels the bulk kernels are built for, each one
+ * implying those below it:
+ *  - GR_CPU_SSE42: SSE4.2 and POPCNT
+ *  - GR_CPU_AVX2: AVX2, FMA and POPCNT
+ *  - GR_CPU_AVX512: AVX-512 F and BW on top of AVX2
+ */
+enum gr_cpu_level_t
+{
+    GR_CPU_GENERIC = 0,
+    GR_CPU_SSE42,
+    GR_CPU_AVX2,
+    GR_CPU_AVX512
+};
+
+/*!
+ * \brief CPU feature queries, as in the old gr_cpu.
+ *
+ * Kernels with several implementations pick one with gr_cpu::level(),
+ * the highest level this CPU supports.  Setting the environment
+ * variable GRCOMPAT_CPU_LEVEL to "generic", "sse4.2", "avx2" or
+ * "avx512" caps the level (it is never raised past the hardware), so
+ * tests can exercise every path on one machine.  The level is read
+ * once, on first use.
+ */
+struct gr_cpu
+{
+    static bool has_mmx(void) {return features().mmx;}
+    static bool has_sse(void) {return features().sse;}
+    static bool has_sse2(void) {return features().sse2;}
+    static bool has_sse3(void) {return features().sse3;}
+    static bool has_ssse3(void) {return features().ssse3;}
+    static bool has_sse4_1(void) {return features().sse4_1;}
+    static bool has_sse4_2(void) {return features().sse4_2;}
+    static bool has_popcnt(void) {return features().popcnt;}
+    static bool has_avx(void) {return features().avx;}
+    static bool has_avx2(void) {return features().avx2;}
+    static bool has_fma(void) {return features().fma;}
+    static bool has_avx512f(void) {return features().avx512f;}
+    static bool has_avx512bw(void) {return features().avx512bw;}
+    static bool has_3dnow(void) {return false;}
+
+    static bool has_altivec(void)
+    {
+        #ifdef __ALTIVEC__
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    static bool has_armv7_a(void)
+    {
+        #ifdef __ARM_ARCH_7A__
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    //! Highest level supported by the hardware
+    static gr_cpu_level_t detected_level(void)
+    {
+        const flags &f = features();
+        if (f.avx2 and f.fma and f.popcnt and f.avx512f and f.avx512bw) return GR_CPU_AVX512;
+        if (f.avx2 and f.fma and f.popcnt) return GR_CPU_AVX2;
+        if (f.sse4_2 and f.popcnt) return GR_CPU_SSE42;
+        return GR_CPU_GENERIC;
+    }
+
+    //! Level the kernels dispatch on: detected_level(), capped by GRCOMPAT_CPU_LEVEL
+    static gr_cpu_level_t level(void)
+    {
+        static const gr_cpu_level_t l = select_level();
+        return l;
+    }
+
+    //! Name of \p level as accepted by GRCOMPAT_CPU_LEVEL
+    static const char *level_name(gr_cpu_level_t level)
+    {
+        switch (level)
+        {
+        case GR_CPU_SSE42: return "sse4.2";
+        case GR_CPU_AVX2: return "avx2";
+        case GR_CPU_AVX512: return "avx512";
+        default: return "generic";
+        }
+    }
+
+private:
+    struct flags
+    {
+        bool mmx, sse, sse2, sse3, ssse3, sse4_1, sse4_2, popcnt;
+        bool avx, avx2, fma, avx512f, avx512bw;
+    };
+
+    static const flags &features(void)
+    {
+        static const flags f = detect();
+        return f;
+    }
+
+    static flags detect(void)
+    {
+        flags f;
+        std::memset(&f, 0, sizeof(f));
+        #ifdef GR_CPU_X86
+        unsigned a, b, c, d;
+        if (__get_cpuid(0, &a, &b, &c, &d) == 0) return f;
+        const unsigned max_leaf = a;
+
+        __cpuid(1, a, b, c, d);
+        f.mmx = (d >> 23) & 1;
+        f.sse = (d >> 25) & 1;
+        f.sse2 = (d >> 26) & 1;
+        f.sse3 = c & 1;
+        f.ssse3 = (c >> 9) & 1;
+        f.sse4_1 = (c >> 19) & 1;
+        f.sse4_2 = (c >> 20) & 1;
+        f.popcnt = (c >> 23) & 1;
+
+        //the AVX registers are only usable when the OS saves them (OSXSAVE + XCR0)
+        const bool osxsave = (c >> 27) & 1;
+        unsigned xcr0 = 0;
+        if (osxsave)
+        {
+            unsigned xcr0_hi;
+            __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+        }
+        const bool os_avx = (xcr0 & 0x06) == 0x06;
+        const bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+        f.avx = os_avx and ((c >> 28) & 1);
+        f.fma = os_avx and ((c >> 12) & 1);
+
+        if (max_leaf >= 7)
+        {
+            __cpuid_count(7, 0, a, b, c, d);
+            f.avx2 = os_avx and ((b >> 5) & 1);
+            f.avx512f = os_avx512 and ((b >> 16) & 1);
+            f.avx512bw = os_avx512 and ((b >> 30) & 1);
+        }
+        #endif
+        return f;
+    }
+
+    static gr_cpu_level_t select_level(void)
+    {
+        const gr_cpu_level_t detected = detected_level();
+        const char *env = std::getenv("GRCOMPAT_CPU_LEVEL");
+        if (env == NULL or *env == '\0') return detected;
+        for (int l = GR_CPU_GENERIC; l <= GR_CPU_AVX512; l++)
+        {
+            if (std::strcmp(env, level_name(gr_cpu_level_t(l))) == 0)
+            {
+                return (l < detected)? gr_cpu_level_t(l) : detected;
+            }
+        }
+        std::cerr << "gr_cpu: ignoring unknown GRCOMPAT_CPU_LEVEL \"" << env << "\"" << std::endl;
+        return detected;
+    }
+};
+
+/*!
+ * Pick a kernel: \p avx2 when gr_cpu::level() allows AVX2, \p generic
+ * otherwise.  Both must have the same (function or member function)
+ * pointer type.  A macro rather than a function, so that builds
+ * without GR_CPU_X86 never name the AVX2 kernel, which does not exist
+ * there.  Keep the result in a function-local static so the choice is
+ * made once:
+ *
+ *   typedef void (*kernel_t)(float *, const float *, size_t, float);
+ *   static const kernel_t k = GR_CPU_SELECT_AVX2(&clip_generic, &clip_avx2);
+ */
+#ifdef GR_CPU_X86
+    #define GR_CPU_SELECT_AVX2(generic, avx2) ((gr_cpu::level() >= GR_CPU_AVX2)? (avx2) : (generic))
+#else
+    #define GR_CPU_SELECT_AVX2(generic, avx2) (generic)
+#endif
+
+#endif //GNURADIO_GR_CPU_H
@@ -3,10 +3,28 @@
 
 #include <gnuradio/math.h>
 #include <gr_complex.h>
+#include <gr_cpu.h>
+#include <gnuradio/endianness.h>
+#include <boost/cstdint.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <boost/static_assert.hpp>
 
-static inline bool gr_is_power_of_2(long x)
+//the power-of-two helpers are usable in constant expressions under C++11
+#if __cplusplus >= 201103L
+    #define GR_MATH_CONSTEXPR constexpr
+#else
+    #define GR_MATH_CONSTEXPR
+#endif
+
+static inline GR_MATH_CONSTEXPR bool gr_is_power_of_2(long x)
 {
-    return gr::is_power_of_2(x);
+    return x != 0 and (x & (x - 1)) == 0;
 }
 
 static inline float gr_fast_atan2f(float y, float x)
@@ -79,26 +97,1232 @@ static inline unsigned int gr_branchless_quad_45deg_slicer(gr_complex x)
     return gr::branchless_quad_45deg_slicer(x);
 }
 
-static inline size_t gr_p2_round_down(size_t x, size_t pow2)
+static inline GR_MATH_CONSTEXPR size_t gr_p2_round_down(size_t x, size_t pow2)
+{
+    return x & -pow2;
+}
+
+static inline GR_MATH_CONSTEXPR size_t gr_p2_round_up(size_t x, size_t pow2)
+{
+    return (x + pow2 - 1) & -pow2;
+}
+
+static inline GR_MATH_CONSTEXPR size_t gr_p2_modulo(size_t x, size_t pow2)
+{
+    return x & (pow2 - 1);
+}
+
+static inline GR_MATH_CONSTEXPR size_t gr_p2_modulo_neg(size_t x, size_t pow2)
+{
+    return pow2 - (x & (pow2 - 1));
+}
+
+/*!
+ * \brief The gr_p2_* helpers for a power of two fixed at compile time.
+ *
+ * The masks are constants, so ring index arithmetic compiles down to
+ * a single AND:
+ *
+ *   typedef gr_p2<1024> ring;
+ *   d_head = ring::modulo(d_head + 1);
+ */
+template <size_t Pow2>
+struct gr_p2
+{
+    BOOST_STATIC_ASSERT(Pow2 != 0 and (Pow2 & (Pow2 - 1)) == 0);
+
+    static const size_t value = Pow2;
+    static const size_t mask = Pow2 - 1;
+
+    static GR_MATH_CONSTEXPR size_t round_down(size_t x) {return x & ~mask;}
+    static GR_MATH_CONSTEXPR size_t round_up(size_t x) {return (x + mask) & ~mask;}
+    static GR_MATH_CONSTEXPR size_t modulo(size_t x) {return x & mask;}
+    static GR_MATH_CONSTEXPR size_t modulo_neg(size_t x) {return Pow2 - (x & mask);}
+};
+
+//! log2 of a power of two at compile time, eg gr_p2_log2<1024>::value == 10
+template <size_t Pow2>
+struct gr_p2_log2
+{
+    BOOST_STATIC_ASSERT(Pow2 > 1 and (Pow2 & (Pow2 - 1)) == 0);
+    static const size_t value = 1 + gr_p2_log2<Pow2/2>::value;
+};
+
+template <>
+struct gr_p2_log2<1>
+{
+    static const size_t value = 0;
+};
+
+/***********************************************************************
+ * Buffer kernels
+ **********************************************************************/
+namespace gr_math_detail
+{
+    //! atan(z) for 0 <= z <= 1, Abramowitz and Stegun 4.4.49 (error 2e-8, below float resolution)
+    inline float atan_poly(float z)
+    {
+        const float z2 = z*z;
+        float p = 0.0028662257f;
+        p = p*z2 - 0.0161657367f;
+        p = p*z2 + 0.0429096138f;
+        p = p*z2 - 0.0752896400f;
+        p = p*z2 + 0.1065626393f;
+        p = p*z2 - 0.1420889944f;
+        p = p*z2 + 0.1999355085f;
+        p = p*z2 - 0.3333314528f;
+        return z + z*z2*p;
+    }
+
+    //! atan2 from atan_poly; written without branches so loops over it vectorize
+    inline float atan2_poly(float y, float x)
+    {
+        const float ax = std::fabs(x), ay = std::fabs(y);
+        const float num = (ay < ax)? ay : ax;
+        const float den = (ay < ax)? ax : ay;
+        float a = atan_poly((den == 0.0f)? 0.0f : num/den);
+        a = (ay > ax)? 1.57079632679f - a : a;
+        a = (x < 0.0f)? 3.14159265359f - a : a;
+        return (y < 0.0f)? -a : a;
+    }
+
+    inline void atan2_generic(float *out, const float *y, const float *x, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = atan2_poly(y[i], x[i]);
+    }
+
+    inline void atan2_complex_generic(float *out, const gr_complex *in, size_t n)
+    {
+        const float *f = reinterpret_cast<const float *>(in);
+        for (size_t i = 0; i < n; i++) out[i] = atan2_poly(f[2*i + 1], f[2*i]);
+    }
+
+    inline void quad_demod_generic(float *out, const gr_complex *in, size_t n, float gain)
+    {
+        const float *f = reinterpret_cast<const float *>(in);
+        for (size_t i = 0; i < n; i++)
+        {
+            //in[i + 1]*conj(in[i])
+            const float pr = f[2*i], pi = f[2*i + 1], cr = f[2*i + 2], ci = f[2*i + 3];
+            out[i] = gain*atan2_poly(ci*pr - cr*pi, cr*pr + ci*pi);
+        }
+    }
+
+    /*!
+     * sin(x) and cos(x) together: reduce by the nearest multiple of pi/2
+     * (three-part Cody-Waite, good to |x| = 8192) then the Cephes
+     * sinf/cosf polynomials on [-pi/4, pi/4] and a quadrant fix-up.
+     * Written without branches, like atan2_poly.
+     */
+    inline void sincos_poly(float x, float &s, float &c)
+    {
+        const int q = int(x*0.636619772f + ((x < 0.0f)? -0.5f : 0.5f));
+        const float k = float(q);
+        const float r = ((x - k*1.5703125f) - k*4.837512969970703125e-4f) - k*7.54978995489188216e-8f;
+        const float r2 = r*r;
+        const float sp = r + r*r2*(-1.6666654611e-1f + r2*(8.3321608736e-3f - r2*1.9515295891e-4f));
+        const float cp = 1.0f - 0.5f*r2 + r2*r2*(4.166664568298827e-2f + r2*(-1.388731625493765e-3f + r2*2.443315711809948e-5f));
+        const float ss = (q & 1)? cp : sp, cc = (q & 1)? sp : cp;
+        s = (q & 2)? -ss : ss;
+        c = ((q + 1) & 2)? -cc : cc;
+    }
+
+    inline void sincos_generic(float *s, float *c, const float *x, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) sincos_poly(x[i], s[i], c[i]);
+    }
+
+    inline void expj_generic(gr_complex *out, const float *phase, size_t n)
+    {
+        float *f = reinterpret_cast<float *>(out);
+        for (size_t i = 0; i < n; i++) sincos_poly(phase[i], f[2*i + 1], f[2*i]);
+    }
+
+    //! One Newton step towards |p| = 1, enough for the drift of a few hundred products
+    inline gr_complex renormalize(float r, float i)
+    {
+        const float g = 1.5f - 0.5f*(r*r + i*i);
+        return gr_complex(r*g, i*g);
+    }
+
+    /*!
+     * out[i] = in[i]*phase*incr^i; \p phase is advanced past the last
+     * sample.  The phasor is renormalized every 512 samples, as in
+     * gr::blocks::rotator.  Products are written out in real arithmetic
+     * so that std::complex does not add its NaN/inf handling.
+     */
+    inline void rotate_generic(gr_complex *out, const gr_complex *in, size_t n, gr_complex &phase, gr_complex incr)
+    {
+        const float *x = reinterpret_cast<const float *>(in);
+        float *y = reinterpret_cast<float *>(out);
+        float pr = phase.real(), pi = phase.imag();
+        const float ir = incr.real(), ii = incr.imag();
+        for (size_t i = 0; i < n; i++)
+        {
+            const float xr = x[2*i], xi = x[2*i + 1];
+            y[2*i] = xr*pr - xi*pi;
+            y[2*i + 1] = xr*pi + xi*pr;
+            const float t = pr*ir - pi*ii;
+            pi = pr*ii + pi*ir;
+            pr = t;
+            if ((i & 511) == 511)
+            {
+                const gr_complex p = renormalize(pr, pi);
+                pr = p.real(); pi = p.imag();
+            }
+        }
+        phase = renormalize(pr, pi);
+    }
+
+    //! Reverse the bit order of a byte, for MSB-first packing
+    inline unsigned reverse_bits8(unsigned b)
+    {
+        b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+        b = ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+        return ((b & 0xaa) >> 1) | ((b & 0x55) << 1);
+    }
+
+    //! Reverse the order of the 2-bit symbols in a byte, for MSB-first packing
+    inline unsigned reverse_pairs8(unsigned b)
+    {
+        b = ((b & 0xf0) >> 4) | ((b & 0x0f) << 4);
+        return ((b & 0xcc) >> 2) | ((b & 0x33) << 2);
+    }
+
+    //! The decisions of gr_quad_45deg_slicer, as bit operations
+    struct quad_45deg
+    {
+        static unsigned symbol(float r, float i)
+        {
+            const unsigned a = (r < 0.0f), b = (i < 0.0f);
+            return (b << 1) | (a ^ b);
+        }
+
+        #ifdef GR_CPU_X86
+        //! Symbols of the four samples in \p v, packed LSB first
+        GR_CPU_TARGET("avx2") static unsigned byte(__m256 v)
+        {
+            const unsigned m = _mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OQ));
+            return m ^ ((m >> 1) & 0x55);
+        }
+        #endif
+    };
+
+    //! The decisions of gr_quad_0deg_slicer, as bit operations
+    struct quad_0deg
+    {
+        static unsigned symbol(float r, float i)
+        {
+            //a tie or a NaN is 3, as in the slicer's if/else ladder
+            if (std::fabs(r) > std::fabs(i)) return (r > 0.0f)? 0 : 2;
+            return (std::fabs(i) > std::fabs(r) and i > 0.0f)? 1 : 3;
+        }
+
+        #ifdef GR_CPU_X86
+        GR_CPU_TARGET("avx2") static unsigned byte(__m256 v)
+        {
+            const __m256 mag = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+            //bit 2k: |r| > |i|, bit 2k + 1: |i| > |r|
+            const unsigned c = _mm256_movemask_ps(_mm256_cmp_ps(mag, _mm256_permute_ps(mag, 0xb1), _CMP_GT_OQ));
+            //bit 2k: not r > 0, bit 2k + 1: not i > 0
+            const unsigned np = ~_mm256_movemask_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GT_OQ));
+            //high bit: 2 when |r| > |i|, else 3 unless |i| > |r| and i > 0
+            const unsigned high = (c & np) | (~c & ((~c | np) >> 1));
+            return (~c & 0x55) | ((high & 0x55) << 1);
+        }
+        #endif
+    };
+
+    inline void binary_packed_generic(unsigned char *out, const float *in, size_t n, bool msb)
+    {
+        for (size_t i = 0; i < n; i += 8)
+        {
+            unsigned b = 0;
+            for (size_t k = 0; k < 8 and i + k < n; k++) b |= unsigned(in[i + k] >= 0.0f) << k;
+            *out++ = msb? reverse_bits8(b) : b;
+        }
+    }
+
+    inline void binary_unpacked_generic(unsigned char *out, const float *in, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = (in[i] >= 0.0f);
+    }
+
+    template <typename Slicer>
+    void quad_packed_generic(unsigned char *out, const gr_complex *in, size_t n, bool msb)
+    {
+        for (size_t i = 0; i < n; i += 4)
+        {
+            unsigned b = 0;
+            for (size_t k = 0; k < 4 and i + k < n; k++) b |= Slicer::symbol(in[i + k].real(), in[i + k].imag()) << (2*k);
+            *out++ = msb? reverse_pairs8(b) : b;
+        }
+    }
+
+    template <typename Slicer>
+    void quad_unpacked_generic(unsigned char *out, const gr_complex *in, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = Slicer::symbol(in[i].real(), in[i].imag());
+    }
+
+    //! Clamp to [-clip, clip]; NaN becomes -clip, as in the SIMD kernels
+    inline float clamp(float x, float clip)
+    {
+        x = (x > -clip)? x : -clip;
+        return (x < clip)? x : clip;
+    }
+
+    inline void clip_generic(float *out, const float *in, size_t n, float clip)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = clamp(in[i], clip);
+    }
+
+    //! round(clamp(x, clip)*scale), saturated to [lo, hi]
+    inline long scale_round(float x, float scale, float clip, float lo, float hi)
+    {
+        const float y = clamp(x, clip)*scale;
+        return lrintf((y > lo)? ((y < hi)? y : hi) : lo);
+    }
+
+    inline void to_int16_generic(boost::int16_t *out, const float *in, size_t n, float scale, float clip)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = boost::int16_t(scale_round(in[i], scale, clip, -32768.0f, 32767.0f));
+    }
+
+    inline void to_int8_generic(boost::int8_t *out, const float *in, size_t n, float scale, float clip)
+    {
+        for (size_t i = 0; i < n; i++) out[i] = boost::int8_t(scale_round(in[i], scale, clip, -128.0f, 127.0f));
+    }
+
+    #ifdef GR_CPU_X86
+
+    //! Eight atan2 at once, the same algorithm as atan2_poly
+    GR_CPU_TARGET("avx2,fma") inline __m256 avx2_atan2(__m256 y, __m256 x)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256 ax = _mm256_andnot_ps(sign, x), ay = _mm256_andnot_ps(sign, y);
+        const __m256 num = _mm256_min_ps(ax, ay), den = _mm256_max_ps(ax, ay);
+        //0/0 gives NaN, which the mask turns into 0
+        const __m256 z = _mm256_and_ps(_mm256_div_ps(num, den), _mm256_cmp_ps(den, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+        const __m256 z2 = _mm256_mul_ps(z, z);
+        __m256 p = _mm256_set1_ps(0.0028662257f);
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(-0.0161657367f));
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(0.0429096138f));
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(-0.0752896400f));
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(0.1065626393f));
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(-0.1420889944f));
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(0.1999355085f));
+        p = _mm256_fmadd_ps(p, z2, _mm256_set1_ps(-0.3333314528f));
+        __m256 a = _mm256_fmadd_ps(_mm256_mul_ps(z, z2), p, z);
+        a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(1.57079632679f), a), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+        a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(3.14159265359f), a), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+        return _mm256_xor_ps(a, _mm256_and_ps(_mm256_cmp_ps(y, _mm256_setzero_ps(), _CMP_LT_OQ), sign));
+    }
+
+    /*!
+     * Split eight complex samples into real and imaginary parts.  The
+     * lanes come out in the order 0 1 4 5 2 3 6 7; avx2_unscramble()
+     * restores the order after element-wise work.
+     */
+    GR_CPU_TARGET("avx2") inline void avx2_deinterleave(const float *f, __m256 &re, __m256 &im)
+    {
+        const __m256 a = _mm256_loadu_ps(f), b = _mm256_loadu_ps(f + 8);
+        re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+
+    GR_CPU_TARGET("avx2") inline __m256 avx2_unscramble(__m256 v)
+    {
+        return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(v), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    //! Store the low bytes of eight int32 lanes (each 0..255)
+    GR_CPU_TARGET("avx2") inline void avx2_store_bytes(unsigned char *out, __m256i v)
+    {
+        const __m256i b = _mm256_packus_epi16(_mm256_packs_epi32(v, v), _mm256_setzero_si256());
+        const boost::uint32_t lo = _mm_cvtsi128_si32(_mm256_castsi256_si128(b));
+        const boost::uint32_t hi = _mm_cvtsi128_si32(_mm256_extracti128_si256(b, 1));
+        std::memcpy(out, &lo, 4);
+        std::memcpy(out + 4, &hi, 4);
+    }
+
+    GR_CPU_TARGET("avx2,fma") inline void atan2_avx2(float *out, const float *y, const float *x, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            _mm256_storeu_ps(out + i, avx2_atan2(_mm256_loadu_ps(y + i), _mm256_loadu_ps(x + i)));
+        }
+        atan2_generic(out + i, y + i, x + i, n - i);
+    }
+
+    GR_CPU_TARGET("avx2,fma") inline void atan2_complex_avx2(float *out, const gr_complex *in, size_t n)
+    {
+        const float *f = reinterpret_cast<const float *>(in);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 re, im;
+            avx2_deinterleave(f + 2*i, re, im);
+            _mm256_storeu_ps(out + i, avx2_unscramble(avx2_atan2(im, re)));
+        }
+        atan2_complex_generic(out + i, in + i, n - i);
+    }
+
+    GR_CPU_TARGET("avx2,fma") inline void quad_demod_avx2(float *out, const gr_complex *in, size_t n, float gain)
+    {
+        const float *f = reinterpret_cast<const float *>(in);
+        const __m256 g = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 pr, pi, cr, ci;
+            avx2_deinterleave(f + 2*i, pr, pi);
+            avx2_deinterleave(f + 2*i + 2, cr, ci);
+            const __m256 re = _mm256_fmadd_ps(cr, pr, _mm256_mul_ps(ci, pi));
+            const __m256 im = _mm256_fmsub_ps(ci, pr, _mm256_mul_ps(cr, pi));
+            _mm256_storeu_ps(out + i, avx2_unscramble(_mm256_mul_ps(g, avx2_atan2(im, re))));
+        }
+        quad_demod_generic(out + i, in + i, n - i, gain);
+    }
+
+    //! Eight sincos at once, the same algorithm as sincos_poly
+    GR_CPU_TARGET("avx2,fma") inline void avx2_sincos(__m256 x, __m256 &s, __m256 &c)
+    {
+        const __m256 k = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.636619772f)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        const __m256i q = _mm256_cvtps_epi32(k);
+        __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(1.5703125f), x);
+        r = _mm256_fnmadd_ps(k, _mm256_set1_ps(4.837512969970703125e-4f), r);
+        r = _mm256_fnmadd_ps(k, _mm256_set1_ps(7.54978995489188216e-8f), r);
+        const __m256 r2 = _mm256_mul_ps(r, r);
+        __m256 sp = _mm256_set1_ps(-1.9515295891e-4f);
+        sp = _mm256_fmadd_ps(sp, r2, _mm256_set1_ps(8.3321608736e-3f));
+        sp = _mm256_fmadd_ps(sp, r2, _mm256_set1_ps(-1.6666654611e-1f));
+        sp = _mm256_fmadd_ps(_mm256_mul_ps(sp, r2), r, r);
+        __m256 cp = _mm256_set1_ps(2.443315711809948e-5f);
+        cp = _mm256_fmadd_ps(cp, r2, _mm256_set1_ps(-1.388731625493765e-3f));
+        cp = _mm256_fmadd_ps(cp, r2, _mm256_set1_ps(4.166664568298827e-2f));
+        cp = _mm256_fmadd_ps(_mm256_mul_ps(cp, r2), r2, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, _mm256_set1_ps(1.0f)));
+        const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+        const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+        //quadrant bit 1 (of q for sin, of q + 1 for cos) moved into the sign bit
+        const __m256 ssign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+        const __m256 csign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+        s = _mm256_xor_ps(_mm256_blendv_ps(sp, cp, swap), ssign);
+        c = _mm256_xor_ps(_mm256_blendv_ps(cp, sp, swap), csign);
+    }
+
+    GR_CPU_TARGET("avx2,fma") inline void sincos_avx2(float *s, float *c, const float *x, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 vs, vc;
+            avx2_sincos(_mm256_loadu_ps(x + i), vs, vc);
+            _mm256_storeu_ps(s + i, vs);
+            _mm256_storeu_ps(c + i, vc);
+        }
+        sincos_generic(s + i, c + i, x + i, n - i);
+    }
+
+    GR_CPU_TARGET("avx2,fma") inline void expj_avx2(gr_complex *out, const float *phase, size_t n)
+    {
+        float *f = reinterpret_cast<float *>(out);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 s, c;
+            avx2_sincos(_mm256_loadu_ps(phase + i), s, c);
+            //lo: samples 0 1 4 5, hi: samples 2 3 6 7
+            const __m256 lo = _mm256_unpacklo_ps(c, s), hi = _mm256_unpackhi_ps(c, s);
+            _mm256_storeu_ps(f + 2*i, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(f + 2*i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+        expj_generic(out + i, phase + i, n - i);
+    }
+
+    //! Four complex products a*b, interleaved I/Q
+    GR_CPU_TARGET("avx2,fma") inline __m256 avx2_cmul(__m256 a, __m256 b)
+    {
+        const __m256 br = _mm256_moveldup_ps(b), bi = _mm256_movehdup_ps(b);
+        return _mm256_fmaddsub_ps(a, br, _mm256_mul_ps(_mm256_permute_ps(a, 0xb1), bi));
+    }
+
+    /*!
+     * rotate_generic four samples at a time: the lanes hold phase*incr^k
+     * for k = 0..3 and step by incr^4.  Each block of 512 samples restarts
+     * the lanes from the phase, which is advanced by incr^512 computed in
+     * double, so the rounding of the float step never accumulates past a
+     * block and the long-term phase stays as accurate as rotate_generic.
+     */
+    GR_CPU_TARGET("avx2,fma") inline void rotate_avx2(gr_complex *out, const gr_complex *in, size_t n, gr_complex &phase, gr_complex incr)
+    {
+        const std::complex<double> d(incr.real(), incr.imag()), d2 = d*d, d3 = d2*d, d4 = d2*d2;
+        std::complex<double> d512 = d4;
+        for (int k = 0; k < 7; k++) d512 *= d512;
+        const __m256 lanes = _mm256_setr_ps(1.0f, 0.0f, incr.real(), incr.imag(),
+            float(d2.real()), float(d2.imag()), float(d3.real()), float(d3.imag()));
+        const float sr = float(d4.real()), si = float(d4.imag());
+        const __m256 step = _mm256_setr_ps(sr, si, sr, si, sr, si, sr, si);
+        const float *x = reinterpret_cast<const float *>(in);
+        float *y = reinterpret_cast<float *>(out);
+        const size_t n4 = n & ~size_t(3);
+        size_t i = 0;
+        while (i < n4)
+        {
+            const size_t start = i, end = std::min(n4, i + 512);
+            const float pr = phase.real(), pi = phase.imag();
+            __m256 p = avx2_cmul(lanes, _mm256_setr_ps(pr, pi, pr, pi, pr, pi, pr, pi));
+            for (; i < end; i += 4)
+            {
+                _mm256_storeu_ps(y + 2*i, avx2_cmul(_mm256_loadu_ps(x + 2*i), p));
+                p = avx2_cmul(p, step);
+            }
+            if (end - start == 512)
+            {
+                const std::complex<double> next = std::complex<double>(pr, pi)*d512;
+                phase = renormalize(float(next.real()), float(next.imag()));
+            }
+            else phase = renormalize(_mm256_cvtss_f32(p), _mm_cvtss_f32(_mm_movehdup_ps(_mm256_castps256_ps128(p))));
+        }
+        rotate_generic(out + i, in + i, n - i, phase, incr);
+    }
+
+    GR_CPU_TARGET("avx2") inline void binary_packed_avx2(unsigned char *out, const float *in, size_t n, bool msb)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32, out += 4)
+        {
+            unsigned b[4];
+            for (size_t k = 0; k < 4; k++)
+            {
+                b[k] = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 8*k), zero, _CMP_GE_OQ));
+                out[k] = msb? reverse_bits8(b[k]) : b[k];
+            }
+        }
+        binary_packed_generic(out, in + i, n - i, msb);
+    }
+
+    GR_CPU_TARGET("avx2") inline void binary_unpacked_avx2(unsigned char *out, const float *in, size_t n)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            //compare masks are 0 or -1, narrowed to bytes by two saturating packs
+            const __m256i a = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i), zero, _CMP_GE_OQ));
+            const __m256i b = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 8), zero, _CMP_GE_OQ));
+            const __m256i c = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 16), zero, _CMP_GE_OQ));
+            const __m256i d = _mm256_castps_si256(_mm256_cmp_ps(_mm256_loadu_ps(in + i + 24), zero, _CMP_GE_OQ));
+            __m256i bytes = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+            bytes = _mm256_and_si256(_mm256_permutevar8x32_epi32(bytes, order), _mm256_set1_epi8(1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), bytes);
+        }
+        binary_unpacked_generic(out + i, in + i, n - i);
+    }
+
+    template <typename Slicer>
+    GR_CPU_TARGET("avx2") void quad_packed_avx2(unsigned char *out, const gr_complex *in, size_t n, bool msb)
+    {
+        const float *f = reinterpret_cast<const float *>(in);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const unsigned b = Slicer::byte(_mm256_loadu_ps(f + 2*i));
+            *out++ = msb? reverse_pairs8(b) : b;
+        }
+        quad_packed_generic<Slicer>(out, in + i, n - i, msb);
+    }
+
+    template <typename Slicer>
+    GR_CPU_TARGET("avx2") void quad_unpacked_avx2(unsigned char *out, const gr_complex *in, size_t n)
+    {
+        const float *f = reinterpret_cast<const float *>(in);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const boost::uint32_t b = Slicer::byte(_mm256_loadu_ps(f + 2*i));
+            const boost::uint32_t w = (b & 0x03) | ((b & 0x0c) << 6) | ((b & 0x30) << 12) | ((b & 0xc0) << 18);
+            std::memcpy(out + i, &w, 4); //x86 is little endian: symbol k lands in byte k
+        }
+        quad_unpacked_generic<Slicer>(out + i, in + i, n - i);
+    }
+
+    GR_CPU_TARGET("avx2") inline void clip_avx2(float *out, const float *in, size_t n, float clip)
+    {
+        const __m256 hi = _mm256_set1_ps(clip), lo = _mm256_set1_ps(-clip);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            //max_ps returns its second operand for NaN, so NaN clamps to -clip
+            _mm256_storeu_ps(out + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), lo), hi));
+        }
+        clip_generic(out + i, in + i, n - i, clip);
+    }
+
+    //! Clamp, scale and convert eight floats to int32 lanes within [-32768, 32767]
+    GR_CPU_TARGET("avx2") inline __m256i avx2_scale_round(const float *in, __m256 clip, __m256 scale)
+    {
+        const __m256 neg = _mm256_sub_ps(_mm256_setzero_ps(), clip);
+        __m256 y = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in), neg), clip), scale);
+        //keep within int16 so the conversion cannot overflow; the packs saturate the rest of the way
+        y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+        return _mm256_cvtps_epi32(y);
+    }
+
+    GR_CPU_TARGET("avx2") inline void to_int16_avx2(boost::int16_t *out, const float *in, size_t n, float scale, float clip)
+    {
+        const __m256 vscale = _mm256_set1_ps(scale), vclip = _mm256_set1_ps(clip);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m256i a = avx2_scale_round(in + i, vclip, vscale);
+            const __m256i b = avx2_scale_round(in + i + 8, vclip, vscale);
+            const __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), w);
+        }
+        to_int16_generic(out + i, in + i, n - i, scale, clip);
+    }
+
+    GR_CPU_TARGET("avx2") inline void to_int8_avx2(boost::int8_t *out, const float *in, size_t n, float scale, float clip)
+    {
+        const __m256 vscale = _mm256_set1_ps(scale), vclip = _mm256_set1_ps(clip);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            const __m256i a = avx2_scale_round(in + i, vclip, vscale);
+            const __m256i b = avx2_scale_round(in + i + 8, vclip, vscale);
+            const __m256i c = avx2_scale_round(in + i + 16, vclip, vscale);
+            const __m256i d = avx2_scale_round(in + i + 24, vclip, vscale);
+            const __m256i w = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_permutevar8x32_epi32(w, order));
+        }
+        to_int8_generic(out + i, in + i, n - i, scale, clip);
+    }
+
+    #endif //GR_CPU_X86
+
+} //namespace gr_math_detail
+
+/*!
+ * out[i] = atan2(y[i], x[i]) for \p n samples.
+ * Polynomial approximation, max error 3e-7 rad (float rounding);
+ * vectorized with AVX2/FMA when gr_cpu::level() allows.
+ */
+static inline void gr_fast_atan2f(float *out, const float *y, const float *x, size_t n)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(float *, const float *, const float *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&atan2_generic, &atan2_avx2);
+    k(out, y, x, n);
+}
+
+//! out[i] = arg(in[i]) for \p n samples, as gr_fast_atan2f(out, y, x, n)
+static inline void gr_fast_atan2f(float *out, const gr_complex *in, size_t n)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(float *, const gr_complex *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&atan2_complex_generic, &atan2_complex_avx2);
+    k(out, in, n);
+}
+
+/*!
+ * Quadrature (FM/FSK) demodulation: out[i] = gain*arg(in[i + 1]*conj(in[i])).
+ * \p in holds \p n + 1 samples, in[0] being the last sample of the
+ * previous call (the history of gr_quadrature_demod_cf).
+ */
+static inline void gr_fast_quadrature_demod(float *out, const gr_complex *in, size_t n, float gain = 1.0f)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(float *, const gr_complex *, size_t, float);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&quad_demod_generic, &quad_demod_avx2);
+    k(out, in, n, gain);
+}
+
+/*!
+ * sin(x) and cos(x) in one call, for per-sample oscillators that would
+ * otherwise call std::sin, std::cos or std::polar.  Polynomial
+ * approximation, max error 1.2e-7 for |x| <= 8192 (keep phases wrapped;
+ * accuracy degrades with larger arguments).
+ */
+static inline void gr_fast_sincosf(float x, float *s, float *c)
+{
+    gr_math_detail::sincos_poly(x, *s, *c);
+}
+
+//! s[i] = sin(x[i]), c[i] = cos(x[i]) for \p n samples, as gr_fast_sincosf
+static inline void gr_fast_sincosf(float *s, float *c, const float *x, size_t n)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(float *, float *, const float *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&sincos_generic, &sincos_avx2);
+    k(s, c, x, n);
+}
+
+//! out[i] = exp(j*phase[i]) for \p n samples, as gr_fast_sincosf
+static inline void gr_fast_expj(gr_complex *out, const float *phase, size_t n)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(gr_complex *, const float *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&expj_generic, &expj_avx2);
+    k(out, phase, n);
+}
+
+/*!
+ * \brief Phase rotator (NCO mixer), as gr::blocks::rotator.
+ *
+ * Multiplies samples by a running unit phasor, which advances by
+ * phase_incr() each sample, for frequency translation without a
+ * sin/cos per sample.  The phasor is renormalized every 512 samples
+ * so its magnitude cannot drift.  rotateN() is vectorized with
+ * AVX2/FMA when gr_cpu::level() allows.
+ *
+ *   gr_rotator r;
+ *   float s, c;
+ *   gr_fast_sincosf(2*M_PI*freq/samp_rate, &s, &c);
+ *   r.set_phase_incr(gr_complex(c, s));
+ *   r.rotateN(out, in, n);
+ */
+class gr_rotator
+{
+public:
+    gr_rotator(void):
+        d_phase(1.0f, 0.0f),
+        d_phase_incr(1.0f, 0.0f)
+    {}
+
+    //! Set the current phasor; it is scaled to unit magnitude, so it must be finite and non-zero
+    void set_phase(gr_complex phase)
+    {
+        d_phase = unit(phase, "gr_rotator: phase must be finite and non-zero");
+    }
+
+    //! Set the per-sample increment; it is scaled to unit magnitude, so it must be finite and non-zero
+    void set_phase_incr(gr_complex incr)
+    {
+        d_phase_incr = unit(incr, "gr_rotator: phase increment must be finite and non-zero");
+    }
+
+    gr_complex phase(void) const
+    {
+        return d_phase;
+    }
+
+    gr_complex phase_incr(void) const
+    {
+        return d_phase_incr;
+    }
+
+    //! Rotate one sample and advance the phasor
+    gr_complex rotate(gr_complex in)
+    {
+        gr_complex z;
+        gr_math_detail::rotate_generic(&z, &in, 1, d_phase, d_phase_incr);
+        return z;
+    }
+
+    //! Rotate \p n samples; \p out may alias \p in
+    void rotateN(gr_complex *out, const gr_complex *in, size_t n)
+    {
+        using namespace gr_math_detail;
+        typedef void (*kernel_t)(gr_complex *, const gr_complex *, size_t, gr_complex &, gr_complex);
+        static const kernel_t k = GR_CPU_SELECT_AVX2(&rotate_generic, &rotate_avx2);
+        k(out, in, n, d_phase, d_phase_incr);
+    }
+
+private:
+    static gr_complex unit(gr_complex x, const char *what)
+    {
+        const float mag = std::abs(x);
+        //also rejects NaN, whose comparisons are all false
+        if (not (mag > 0.0f and mag <= std::numeric_limits<float>::max())) throw std::invalid_argument(what);
+        return x/mag;
+    }
+
+    gr_complex d_phase;
+    gr_complex d_phase_incr;
+};
+
+
+/*!
+ * Slice \p n samples as gr_binary_slicer, one symbol (0 or 1) per output byte.
+ */
+static inline void gr_binary_slicer(unsigned char *out, const float *in, size_t n)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(unsigned char *, const float *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&binary_unpacked_generic, &binary_unpacked_avx2);
+    k(out, in, n);
+}
+
+/*!
+ * Slice \p n samples as gr_binary_slicer and pack the bits, eight per
+ * byte, into (n + 7)/8 bytes.  With GR_MSB_FIRST the first sample is
+ * bit 7 of out[0]; with GR_LSB_FIRST it is bit 0.  Unused bits of the
+ * last byte are zero.
+ */
+static inline void gr_binary_slicer_packed(unsigned char *out, const float *in, size_t n,
+    gr::endianness_t order = gr::GR_MSB_FIRST)
 {
-    return gr::p2_round_down(x, pow2);
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(unsigned char *, const float *, size_t, bool);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&binary_packed_generic, &binary_packed_avx2);
+    k(out, in, n, order == gr::GR_MSB_FIRST);
 }
 
-static inline size_t gr_p2_round_up(size_t x, size_t pow2)
+//! Slice \p n samples as gr_quad_0deg_slicer, one symbol (0..3) per output byte
+static inline void gr_quad_0deg_slicer(unsigned char *out, const gr_complex *in, size_t n)
 {
-    return gr::p2_round_up(x, pow2);
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(unsigned char *, const gr_complex *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&quad_unpacked_generic<quad_0deg>, &quad_unpacked_avx2<quad_0deg>);
+    k(out, in, n);
 }
 
-static inline size_t gr_p2_modulo(size_t x, size_t pow2)
+//! Slice \p n samples as gr_quad_45deg_slicer, one symbol (0..3) per output byte
+static inline void gr_quad_45deg_slicer(unsigned char *out, const gr_complex *in, size_t n)
 {
-    return gr::p2_modulo(x, pow2);
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(unsigned char *, const gr_complex *, size_t);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&quad_unpacked_generic<quad_45deg>, &quad_unpacked_avx2<quad_45deg>);
+    k(out, in, n);
 }
 
-static inline size_t gr_p2_modulo_neg(size_t x, size_t pow2)
+/*!
+ * Slice \p n samples as gr_quad_0deg_slicer and pack the symbols, four
+ * per byte, into (n + 3)/4 bytes.  With GR_MSB_FIRST the first symbol
+ * is bits 7-6 of out[0] (its high bit first, as unpack_k_bits expects);
+ * with GR_LSB_FIRST it is bits 1-0.  Unused bits of the last byte are zero.
+ */
+static inline void gr_quad_0deg_slicer_packed(unsigned char *out, const gr_complex *in, size_t n,
+    gr::endianness_t order = gr::GR_MSB_FIRST)
 {
-    return gr::p2_modulo_neg(x, pow2);
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(unsigned char *, const gr_complex *, size_t, bool);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&quad_packed_generic<quad_0deg>, &quad_packed_avx2<quad_0deg>);
+    k(out, in, n, order == gr::GR_MSB_FIRST);
 }
 
+//! Slice \p n samples as gr_quad_45deg_slicer and pack them as gr_quad_0deg_slicer_packed
+static inline void gr_quad_45deg_slicer_packed(unsigned char *out, const gr_complex *in, size_t n,
+    gr::endianness_t order = gr::GR_MSB_FIRST)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(unsigned char *, const gr_complex *, size_t, bool);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&quad_packed_generic<quad_45deg>, &quad_packed_avx2<quad_45deg>);
+    k(out, in, n, order == gr::GR_MSB_FIRST);
+}
+
+
+//! out[i] = gr_clip(in[i], clip) for \p n samples (in place is fine)
+static inline void gr_clip(float *out, const float *in, size_t n, float clip)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(float *, const float *, size_t, float);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&clip_generic, &clip_avx2);
+    k(out, in, n, clip);
+}
+
+/*!
+ * Clip \p n floats to [-clip, clip], scale them and round to int16,
+ * saturating: out[i] = round(gr_clip(in[i], clip)*scale).  The
+ * defaults map [-1, 1] onto the full range for a DAC.
+ */
+static inline void gr_float_to_int16(boost::int16_t *out, const float *in, size_t n,
+    float scale = 32767.0f, float clip = 1.0f)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(boost::int16_t *, const float *, size_t, float, float);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&to_int16_generic, &to_int16_avx2);
+    k(out, in, n, scale, clip);
+}
+
+//! As gr_float_to_int16, to int8
+static inline void gr_float_to_int8(boost::int8_t *out, const float *in, size_t n,
+    float scale = 127.0f, float clip = 1.0f)
+{
+    using namespace gr_math_detail;
+    typedef void (*kernel_t)(boost::int8_t *, const float *, size_t, float, float);
+    static const kernel_t k = GR_CPU_SELECT_AVX2(&to_int8_generic, &to_int8_avx2);
+    k(out, in, n, scale, clip);
+}
+
+//! Convert \p n complex samples to interleaved int16 I/Q (sc16), as gr_float_to_int16
+static inline void gr_complex_to_sc16(boost::int16_t *out, const gr_complex *in, size_t n,
+    float scale = 32767.0f, float clip = 1.0f)
+{
+    gr_float_to_int16(out, reinterpret_cast<const float *>(in), 2*n, scale, clip);
+}
+
+//! Convert \p n complex samples to interleaved int8 I/Q (sc8), as gr_float_to_int8
+static inline void gr_complex_to_sc8(boost::int8_t *out, const gr_complex *in, size_t n,
+    float scale = 127.0f, float clip = 1.0f)
+{
+    gr_float_to_int8(out, reinterpret_cast<const float *>(in), 2*n, scale, clip);
+}
+
+/*!
+ * \brief Hard and soft decisions for square QAM (4, 16, 64 or 256 points).
+ *
+ * Each axis is a Gray-coded PAM of L = sqrt(M) levels at odd multiples
+ * of \p scale; the symbol index is the I-axis Gray code in the high
+ * bits and the Q-axis code in the low bits, so adjacent points differ
+ * in one bit.  points() lists the constellation by symbol index.
+ *
+ * Hard decisions round each axis onto the grid: constant time per
+ * symbol whatever M is.  Soft decisions are max-log LLRs computed per
+ * axis, O(sqrt(M)) per symbol instead of a search over all M points.
+ */
+class gr_qam_slicer
+{
+public:
+    /*!
+     * \param order number of points, 4, 16, 64 or 256
+     * \param scale half the distance between neighbouring points;
+     *        0 picks the scale giving unit average power
+     */
+    explicit gr_qam_slicer(unsigned order, float scale = 0.0f):
+        d_order(order),
+        d_bits(0)
+    {
+        if (order != 4 and order != 16 and order != 64 and order != 256)
+        {
+            throw std::invalid_argument("gr_qam_slicer: order must be 4, 16, 64 or 256");
+        }
+        while ((1u << d_bits) < order) d_bits++;
+        d_axis_bits = d_bits/2;
+        d_levels = 1u << d_axis_bits;
+        d_scale = (scale > 0.0f)? scale : std::sqrt(3.0f/(2.0f*(d_levels*d_levels - 1)));
+
+        for (unsigned j = 0; j < d_levels; j++)
+        {
+            d_level.push_back((2.0f*j - (d_levels - 1))*d_scale);
+            d_gray.push_back(j ^ (j >> 1));
+        }
+        d_points.resize(order);
+        for (unsigned i = 0; i < d_levels; i++)
+        {
+            for (unsigned q = 0; q < d_levels; q++)
+            {
+                d_points[(d_gray[i] << d_axis_bits) | d_gray[q]] = gr_complex(d_level[i], d_level[q]);
+            }
+        }
+    }
+
+    unsigned order(void) const {return d_order;}
+    unsigned bits_per_symbol(void) const {return d_bits;}
+    float scale(void) const {return d_scale;}
+
+    //! The constellation, indexed by symbol
+    const std::vector<gr_complex> &points(void) const {return d_points;}
+
+    //! Symbol index of the point nearest \p x
+    unsigned slice(gr_complex x) const
+    {
+        return (d_gray[axis_index(x.real())] << d_axis_bits) | d_gray[axis_index(x.imag())];
+    }
+
+    //! Slice \p n samples, one symbol index per output byte
+    void slice(unsigned char *out, const gr_complex *in, size_t n) const
+    {
+        typedef void (gr_qam_slicer::*kernel_t)(unsigned char *, const gr_complex *, size_t) const;
+        static const kernel_t k = GR_CPU_SELECT_AVX2(&gr_qam_slicer::slice_generic, &gr_qam_slicer::slice_avx2);
+        (this->*k)(out, in, n);
+    }
+
+    /*!
+     * Max-log LLRs of the bits of \p n samples: bits_per_symbol() values
+     * per sample, symbol MSB first, positive favouring a 1 bit (the sign
+     * convention of gr::constellation soft decisions).  \p npwr is the
+     * noise power per complex sample.
+     */
+    void soft_bits(float *llr, const gr_complex *in, size_t n, float npwr = 1.0f) const
+    {
+        typedef void (gr_qam_slicer::*kernel_t)(float *, const gr_complex *, size_t, float) const;
+        static const kernel_t k = GR_CPU_SELECT_AVX2(&gr_qam_slicer::soft_bits_generic, &gr_qam_slicer::soft_bits_avx2);
+        (this->*k)(llr, in, n, 1.0f/npwr);
+    }
+
+private:
+    void slice_generic(unsigned char *out, const gr_complex *in, size_t n) const
+    {
+        for (size_t i = 0; i < n; i++) out[i] = slice(in[i]);
+    }
+
+    void soft_bits_generic(float *llr, const gr_complex *in, size_t n, float inv) const
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            axis_llr(llr + i*d_bits, in[i].real(), inv);
+            axis_llr(llr + i*d_bits + d_axis_bits, in[i].imag(), inv);
+        }
+    }
+
+    //! Grid position 0..L-1 of the level nearest \p x
+    unsigned axis_index(float x) const
+    {
+        const float f = std::floor(x*(0.5f/d_scale) + 0.5f*d_levels);
+        return (f <= 0.0f)? 0 : (f >= d_levels - 1)? d_levels - 1 : unsigned(f);
+    }
+
+    //! Max-log LLRs of the Gray bits of one axis
+    void axis_llr(float *llr, float x, float inv) const
+    {
+        float min0[4], min1[4];
+        for (unsigned k = 0; k < d_axis_bits; k++) min0[k] = min1[k] = 1e30f;
+        for (unsigned j = 0; j < d_levels; j++)
+        {
+            const float e = (x - d_level[j])*(x - d_level[j]);
+            for (unsigned k = 0; k < d_axis_bits; k++)
+            {
+                float &m = ((d_gray[j] >> (d_axis_bits - 1 - k)) & 1)? min1[k] : min0[k];
+                m = std::min(m, e);
+            }
+        }
+        for (unsigned k = 0; k < d_axis_bits; k++) llr[k] = (min0[k] - min1[k])*inv;
+    }
+
+    #ifdef GR_CPU_X86
+    //! Nearest grid position of eight values, as int32 lanes
+    GR_CPU_TARGET("avx2,fma") __m256i avx2_axis_index(__m256 x) const
+    {
+        __m256 f = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(0.5f/d_scale), _mm256_set1_ps(0.5f*d_levels)));
+        f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), _mm256_set1_ps(d_levels - 1.0f));
+        return _mm256_cvttps_epi32(f);
+    }
+
+    GR_CPU_TARGET("avx2,fma") void slice_avx2(unsigned char *out, const gr_complex *in, size_t n) const
+    {
+        using namespace gr_math_detail;
+        const float *f = reinterpret_cast<const float *>(in);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 re, im;
+            avx2_deinterleave(f + 2*i, re, im);
+            __m256i ji = avx2_axis_index(re), jq = avx2_axis_index(im);
+            const __m256i gi = _mm256_xor_si256(ji, _mm256_srli_epi32(ji, 1));
+            const __m256i gq = _mm256_xor_si256(jq, _mm256_srli_epi32(jq, 1));
+            __m256i sym = _mm256_or_si256(_mm256_slli_epi32(gi, int(d_axis_bits)), gq);
+            sym = _mm256_permute4x64_epi64(sym, _MM_SHUFFLE(3, 1, 2, 0));
+            avx2_store_bytes(out + i, sym);
+        }
+        slice_generic(out + i, in + i, n - i);
+    }
+
+    GR_CPU_TARGET("avx2,fma") void avx2_axis_llr(__m256 x, __m256 inv, __m256 *llr) const
+    {
+        __m256 min0[4], min1[4];
+        for (unsigned k = 0; k < d_axis_bits; k++) min0[k] = min1[k] = _mm256_set1_ps(1e30f);
+        for (unsigned j = 0; j < d_levels; j++)
+        {
+            const __m256 d = _mm256_sub_ps(x, _mm256_set1_ps(d_level[j]));
+            const __m256 e = _mm256_mul_ps(d, d);
+            for (unsigned k = 0; k < d_axis_bits; k++)
+            {
+                __m256 &m = ((d_gray[j] >> (d_axis_bits - 1 - k)) & 1)? min1[k] : min0[k];
+                m = _mm256_min_ps(m, e);
+            }
+        }
+        for (unsigned k = 0; k < d_axis_bits; k++) llr[k] = _mm256_mul_ps(_mm256_sub_ps(min0[k], min1[k]), inv);
+    }
+
+    GR_CPU_TARGET("avx2,fma") void soft_bits_avx2(float *llr, const gr_complex *in, size_t n, float inv) const
+    {
+        using namespace gr_math_detail;
+        const float *f = reinterpret_cast<const float *>(in);
+        const __m256 vinv = _mm256_set1_ps(inv);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 re, im, bits[8];
+            avx2_deinterleave(f + 2*i, re, im);
+            avx2_axis_llr(re, vinv, bits);
+            avx2_axis_llr(im, vinv, bits + d_axis_bits);
+            //transpose from one vector per bit to bits_per_symbol() values per sample
+            float lanes[8][8];
+            for (unsigned k = 0; k < d_bits; k++) _mm256_storeu_ps(lanes[k], avx2_unscramble(bits[k]));
+            for (size_t s = 0; s < 8; s++)
+            {
+                for (unsigned k = 0; k < d_bits; k++) llr[(i + s)*d_bits + k] = lanes[k][s];
+            }
+        }
+        soft_bits_generic(llr + i*d_bits, in + i, n - i, inv);
+    }
+    #endif //GR_CPU_X86
+
+    unsigned d_order, d_bits, d_axis_bits, d_levels;
+    float d_scale;
+    std::vector<float> d_level; //!< position of each grid level
+    std::vector<unsigned> d_gray; //!< Gray code of each grid level
+    std::vector<gr_complex> d_points;
+};
+
+/*!
+ * \brief Hard and soft decisions for APSK (concentric PSK rings).
+ *
+ * Ring r has counts[r] points at radius radii[r], the first at angle
+ * phases[r] (0 if not given), then evenly spaced counter-clockwise.
+ * Symbols are numbered ring by ring from the innermost; the symbol
+ * index is used as the bit label, so map it through a table for
+ * standard labelings such as DVB-S2.
+ *
+ * Hard decisions pick the ring by magnitude (midpoint thresholds) and
+ * the point by angle: constant time per symbol.  Soft decisions are
+ * exact max-log LLRs and search all points.
+ */
+class gr_apsk_slicer
+{
+public:
+    gr_apsk_slicer(const std::vector<unsigned> &counts, const std::vector<float> &radii,
+        const std::vector<float> &phases = std::vector<float>()):
+        d_counts(counts),
+        d_radii(radii),
+        d_phases(phases)
+    {
+        if (counts.empty() or counts.size() != radii.size() or (not phases.empty() and phases.size() != radii.size()))
+        {
+            throw std::invalid_argument("gr_apsk_slicer: need one count, radius (and phase) per ring");
+        }
+        d_phases.resize(radii.size(), 0.0f);
+        unsigned order = 0;
+        for (size_t r = 0; r < radii.size(); r++)
+        {
+            if (counts[r] == 0 or (r > 0 and radii[r] <= radii[r - 1]))
+            {
+                throw std::invalid_argument("gr_apsk_slicer: rings need points and increasing radii");
+            }
+            d_offsets.push_back(order);
+            order += counts[r];
+            if (r > 0) d_thresholds.push_back(0.25f*(radii[r - 1] + radii[r])*(radii[r - 1] + radii[r]));
+            for (unsigned k = 0; k < counts[r]; k++)
+            {
+                d_points.push_back(std::polar(radii[r], d_phases[r] + float(2*M_PI*k/counts[r])));
+            }
+        }
+        if (order > 256 or not gr_is_power_of_2(order))
+        {
+            throw std::invalid_argument("gr_apsk_slicer: the number of points must be a power of 2, at most 256");
+        }
+        d_bits = 0;
+        while ((1u << d_bits) < order) d_bits++;
+    }
+
+    unsigned order(void) const {return unsigned(d_points.size());}
+    unsigned bits_per_symbol(void) const {return d_bits;}
+
+    //! The constellation, indexed by symbol
+    const std::vector<gr_complex> &points(void) const {return d_points;}
+
+    //! Symbol index of the point nearest \p x (ring first, then angle)
+    unsigned slice(gr_complex x) const
+    {
+        const float mag2 = x.real()*x.real() + x.imag()*x.imag();
+        size_t r = 0;
+        while (r < d_thresholds.size() and mag2 > d_thresholds[r]) r++;
+        const float turns = (gr_math_detail::atan2_poly(x.imag(), x.real()) - d_phases[r])*float(0.5/M_PI);
+        const float k = std::floor(turns*d_counts[r] + 0.5f);
+        const float n = float(d_counts[r]);
+        return d_offsets[r] + unsigned(k - n*std::floor(k/n));
+    }
+
+    //! Slice \p n samples, one symbol index per output byte
+    void slice(unsigned char *out, const gr_complex *in, size_t n) const
+    {
+        typedef void (gr_apsk_slicer::*kernel_t)(unsigned char *, const gr_complex *, size_t) const;
+        static const kernel_t k = GR_CPU_SELECT_AVX2(&gr_apsk_slicer::slice_generic, &gr_apsk_slicer::slice_avx2);
+        (this->*k)(out, in, n);
+    }
+
+    //! Max-log LLRs, laid out and signed as gr_qam_slicer::soft_bits()
+    void soft_bits(float *llr, const gr_complex *in, size_t n, float npwr = 1.0f) const
+    {
+        const float inv = 1.0f/npwr;
+        for (size_t i = 0; i < n; i++)
+        {
+            float min0[8], min1[8];
+            for (unsigned k = 0; k < d_bits; k++) min0[k] = min1[k] = 1e30f;
+            for (unsigned s = 0; s < d_points.size(); s++)
+            {
+                const float e = std::norm(in[i] - d_points[s]);
+                for (unsigned k = 0; k < d_bits; k++)
+                {
+                    float &m = ((s >> (d_bits - 1 - k)) & 1)? min1[k] : min0[k];
+                    m = std::min(m, e);
+                }
+            }
+            for (unsigned k = 0; k < d_bits; k++) llr[i*d_bits + k] = (min0[k] - min1[k])*inv;
+        }
+    }
+
+private:
+    void slice_generic(unsigned char *out, const gr_complex *in, size_t n) const
+    {
+        for (size_t i = 0; i < n; i++) out[i] = slice(in[i]);
+    }
+
+    #ifdef GR_CPU_X86
+    GR_CPU_TARGET("avx2,fma") void slice_avx2(unsigned char *out, const gr_complex *in, size_t n) const
+    {
+        using namespace gr_math_detail;
+        //the ring lookups below are one 8-lane permute
+        if (d_radii.size() > 8)
+        {
+            slice_generic(out, in, n);
+            return;
+        }
+
+        //per-ring constants, looked up by ring number with permutevar
+        float count[8] = {0}, phase[8] = {0};
+        int offset[8] = {0};
+        for (size_t r = 0; r < d_radii.size(); r++)
+        {
+            count[r] = float(d_counts[r]);
+            phase[r] = d_phases[r];
+            offset[r] = int(d_offsets[r]);
+        }
+        const __m256 vcount = _mm256_loadu_ps(count), vphase = _mm256_loadu_ps(phase);
+        const __m256i voffset = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(offset));
+
+        const float *f = reinterpret_cast<const float *>(in);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 re, im;
+            avx2_deinterleave(f + 2*i, re, im);
+            const __m256 mag2 = _mm256_fmadd_ps(re, re, _mm256_mul_ps(im, im));
+            __m256i ring = _mm256_setzero_si256();
+            for (size_t r = 0; r < d_thresholds.size(); r++)
+            {
+                //compare masks are -1 where the sample is outside the threshold
+                const __m256 out_r = _mm256_cmp_ps(mag2, _mm256_set1_ps(d_thresholds[r]), _CMP_GT_OQ);
+                ring = _mm256_sub_epi32(ring, _mm256_castps_si256(out_r));
+            }
+            const __m256 cnt = _mm256_permutevar8x32_ps(vcount, ring);
+            const __m256 turns = _mm256_mul_ps(_mm256_sub_ps(avx2_atan2(im, re), _mm256_permutevar8x32_ps(vphase, ring)),
+                _mm256_set1_ps(float(0.5/M_PI)));
+            const __m256 k = _mm256_floor_ps(_mm256_fmadd_ps(turns, cnt, _mm256_set1_ps(0.5f)));
+            const __m256 wrapped = _mm256_fnmadd_ps(cnt, _mm256_floor_ps(_mm256_div_ps(k, cnt)), k);
+            __m256i sym = _mm256_add_epi32(_mm256_permutevar8x32_epi32(voffset, ring), _mm256_cvttps_epi32(wrapped));
+            sym = _mm256_permute4x64_epi64(sym, _MM_SHUFFLE(3, 1, 2, 0));
+            avx2_store_bytes(out + i, sym);
+        }
+        slice_generic(out + i, in + i, n - i);
+    }
+    #endif //GR_CPU_X86
+
+    std::vector<unsigned> d_counts;
+    std::vector<float> d_radii, d_phases;
+    std::vector<unsigned> d_offsets; //!< symbol index of the first point of each ring
+    std::vector<float> d_thresholds; //!< squared magnitude between each pair of rings
+    std::vector<gr_complex> d_points;
+    unsigned d_bits;
+};
+
 #endif //GNURADIO_GR_MATH_H
 
 #warning GR-COMPAT REQUIRED TO COMPILE - OUTDATED GNURADIO API IN USE - PLEASE UPDATE YOUR MODULE!!!
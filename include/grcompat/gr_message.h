@@ -4,6 +4,8 @@
 #define GNURADIO_GR_MESSAGE_H
 
 #include <gnuradio/message.h>
+#include <cstring>
+#include <string>
 
 typedef gr::message gr_message;
 typedef gr::message::sptr gr_message_sptr;
@@ -13,12 +15,37 @@ static inline gr_message_sptr gr_make_message(long type = 0, double arg1 = 0, do
     return gr::message::make(type, arg1, arg2, length);
 }
 
-static inline gr_message_sptr gr_make_message_from_string(const std::string s, long type = 0,
+static inline gr_message_sptr gr_make_message_from_string(const std::string &s, long type = 0,
                                  double arg1 = 0, double arg2 = 0)
-                                 {
-                                     
-    return gr::message::make_from_string(s, type, arg1, arg2);
-                                 }
+{
+    //gr::message::make_from_string takes the string by value, copy straight into the payload instead
+    gr_message_sptr msg = gr::message::make(type, arg1, arg2, s.size());
+    if (not s.empty()) std::memcpy(msg->msg(), s.data(), s.size());
+    return msg;
+}
+
+//! Make a message holding a copy of \p length bytes at \p buf (one copy, no temporary string)
+static inline gr_message_sptr gr_make_message_from_buffer(const void *buf, size_t length, long type = 0,
+                                 double arg1 = 0, double arg2 = 0)
+{
+    gr_message_sptr msg = gr::message::make(type, arg1, arg2, length);
+    if (length != 0) std::memcpy(msg->msg(), buf, length);
+    return msg;
+}
+
+/*!
+ * Make a message with a \p length byte payload and let \p fill write it in place.
+ * fill(unsigned char *payload, size_t length) is called once before the message is returned,
+ * so a producer can serialize or receive directly into the payload without a staging buffer.
+ */
+template <typename Fill>
+gr_message_sptr gr_make_message_fill(size_t length, Fill fill, long type = 0,
+                                 double arg1 = 0, double arg2 = 0)
+{
+    gr_message_sptr msg = gr::message::make(type, arg1, arg2, length);
+    fill(msg->msg(), length);
+    return msg;
+}
 
 #endif //GNURADIO_GR_MESSAGE_H
 
@@ -0,0 +1,219 @@
+//Reduce, reuse, recycle
+
+#ifndef GNURADIO_GR_MESSAGE_POOL_H
+#define GNURADIO_GR_MESSAGE_POOL_H
+
+#include <gr_message.h>
+#include <gruel/thread.h>
+#include <gruel/lock_profiler.h>
+#include <gruel/numa.h>
+#include <boost/bind/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+//! Occupancy of one payload size class of a gr_message_pool
+struct gr_message_pool_class_stats
+{
+    size_t length; //!< payload length of the messages in this class
+    size_t idle; //!< messages waiting in the pool
+    size_t in_use; //!< messages handed out and not yet released
+    size_t hits; //!< requests served from the pool
+    size_t misses; //!< requests that had to allocate a new message
+    size_t discarded; //!< released messages freed because the class was full
+};
+
+/*!
+ * \brief Recycles gr_message objects and their payload buffers.
+ *
+ * A gr_message's payload length is fixed when it is created, so each
+ * size class holds messages of one payload length.  make() hands out
+ * a recycled message of the requested length when one is idle, and
+ * allocates a new one otherwise.  When the last gr_message_sptr to a
+ * pooled message is released, the message goes back to its class
+ * instead of being freed (up to max_idle per class).  Messages still
+ * in use when the pool is destroyed are simply freed on release.
+ *
+ * Recycled payloads are not cleared; type, arg1 and arg2 are reset.
+ */
+class gr_message_pool : boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<gr_message_pool> sptr;
+
+    explicit gr_message_pool(size_t max_idle = 64):
+        d_impl(boost::make_shared<impl_t>(max_idle))
+    {}
+
+    //! Return a message with a \p length byte payload, recycled when possible
+    gr_message_sptr make(long type = 0, double arg1 = 0, double arg2 = 0, size_t length = 0)
+    {
+        gr_message_sptr owner;
+        {
+            GRUEL_PROFILED_LOCK(lock, d_impl->mutex);
+            class_t &c = d_impl->classes[length];
+            c.in_use++;
+            if (c.idle.empty()) c.misses++;
+            else
+            {
+                c.hits++;
+                owner.swap(c.idle.back());
+                c.idle.pop_back();
+            }
+        }
+
+        if (owner)
+        {
+            owner->set_type(type);
+            owner->set_arg1(arg1);
+            owner->set_arg2(arg2);
+        }
+        else owner = gr::message::make(type, arg1, arg2, length);
+
+        gr::message *msg = owner.get();
+        return gr_message_sptr(msg, recycler(d_impl, owner));
+    }
+
+    //! Return a message holding a copy of \p s, recycled when possible
+    gr_message_sptr make_from_string(const std::string &s, long type = 0, double arg1 = 0, double arg2 = 0)
+    {
+        gr_message_sptr msg = make(type, arg1, arg2, s.size());
+        if (not s.empty()) std::memcpy(msg->msg(), s.data(), s.size());
+        return msg;
+    }
+
+    //! Return a message holding a copy of \p length bytes at \p buf, recycled when possible
+    gr_message_sptr make_from_buffer(const void *buf, size_t length, long type = 0, double arg1 = 0, double arg2 = 0)
+    {
+        gr_message_sptr msg = make(type, arg1, arg2, length);
+        if (length != 0) std::memcpy(msg->msg(), buf, length);
+        return msg;
+    }
+
+    //! Like gr_make_message_fill, with a recycled message when possible
+    template <typename Fill>
+    gr_message_sptr make_fill(size_t length, Fill fill, long type = 0, double arg1 = 0, double arg2 = 0)
+    {
+        gr_message_sptr msg = make(type, arg1, arg2, length);
+        fill(msg->msg(), length);
+        return msg;
+    }
+
+    //! Allocate idle messages so that class \p length holds at least \p n
+    void reserve(size_t length, size_t n)
+    {
+        GRUEL_PROFILED_LOCK(lock, d_impl->mutex);
+        class_t &c = d_impl->classes[length];
+        while (c.idle.size() < n) c.idle.push_back(gr::message::make(0, 0, 0, length));
+    }
+
+    /*!
+     * Like reserve(), but the new messages are allocated and their
+     * payloads first touched by a thread pinned to NUMA \p node, so
+     * the kernel places them in that node's memory.
+     */
+    void reserve_on_node(size_t length, size_t n, int node)
+    {
+        gruel::numa_run_on_node(node, boost::bind(&gr_message_pool::reserve_touched, this, length, n));
+    }
+
+    //! Free all idle messages
+    void clear(void)
+    {
+        GRUEL_PROFILED_LOCK(lock, d_impl->mutex);
+        for (class_map_t::iterator it = d_impl->classes.begin(); it != d_impl->classes.end(); ++it)
+        {
+            it->second.idle.clear();
+        }
+    }
+
+    //! Return occupancy statistics for every size class, ordered by length
+    std::vector<gr_message_pool_class_stats> stats(void) const
+    {
+        std::vector<gr_message_pool_class_stats> out;
+        GRUEL_PROFILED_LOCK(lock, d_impl->mutex);
+        for (class_map_t::const_iterator it = d_impl->classes.begin(); it != d_impl->classes.end(); ++it)
+        {
+            gr_message_pool_class_stats s;
+            s.length = it->first;
+            s.idle = it->second.idle.size();
+            s.in_use = it->second.in_use;
+            s.hits = it->second.hits;
+            s.misses = it->second.misses;
+            s.discarded = it->second.discarded;
+            out.push_back(s);
+        }
+        return out;
+    }
+
+private:
+    void reserve_touched(size_t length, size_t n)
+    {
+        GRUEL_PROFILED_LOCK(lock, d_impl->mutex);
+        class_t &c = d_impl->classes[length];
+        while (c.idle.size() < n)
+        {
+            gr_message_sptr msg = gr::message::make(0, 0, 0, length);
+            if (length != 0) std::memset(msg->msg(), 0, length);
+            c.idle.push_back(msg);
+        }
+    }
+
+    struct class_t
+    {
+        class_t(void): in_use(0), hits(0), misses(0), discarded(0){}
+        std::vector<gr_message_sptr> idle;
+        size_t in_use, hits, misses, discarded;
+    };
+
+    typedef std::map<size_t, class_t> class_map_t;
+
+    struct impl_t
+    {
+        impl_t(size_t max_idle): max_idle(max_idle){}
+        gruel::mutex mutex;
+        class_map_t classes;
+        const size_t max_idle;
+    };
+
+    //! shared_ptr deleter that hands the owning reference back to the pool
+    struct recycler
+    {
+        recycler(const boost::shared_ptr<impl_t> &impl, const gr_message_sptr &owner):
+            impl(impl), owner(owner)
+        {}
+
+        void operator()(gr::message *)
+        {
+            gr_message_sptr msg;
+            msg.swap(owner);
+            boost::shared_ptr<impl_t> pool = impl.lock();
+            if (not pool) return;
+
+            GRUEL_PROFILED_LOCK(lock, pool->mutex);
+            class_t &c = pool->classes[msg->length()];
+            c.in_use--;
+            if (c.idle.size() < pool->max_idle) c.idle.push_back(msg);
+            else c.discarded++;
+        }
+
+        boost::weak_ptr<impl_t> impl;
+        gr_message_sptr owner;
+    };
+
+    boost::shared_ptr<impl_t> d_impl;
+};
+
+typedef gr_message_pool::sptr gr_message_pool_sptr;
+
+static inline gr_message_pool_sptr gr_make_message_pool(size_t max_idle = 64)
+{
+    return gr_message_pool_sptr(new gr_message_pool(max_idle));
+}
+
+#endif //GNURADIO_GR_MESSAGE_POOL_H
@@ -0,0 +1,549 @@
+//Lock free, but not free of charge
+
+#ifndef GNURADIO_GR_MPMC_MSG_QUEUE_H
+#define GNURADIO_GR_MPMC_MSG_QUEUE_H
+
+#include <gr_message.h>
+#include <gr_msg_queue_stats.h>
+#include <gnuradio/msg_handler.h>
+#include <gruel/futex.h>
+#include <gruel/histogram.h>
+#include <gruel/thread.h>
+#include <gruel/lock_profiler.h>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <cstddef>
+
+/*!
+ * \brief Bounded lock-free multi-producer/multi-consumer message queue.
+ *
+ * A drop-in alternative to gr_msg_queue for many producer threads.
+ * Messages live in a ring of slots, each with its own sequence number
+ * (Vyukov's bounded MPMC queue), so producers and consumers only
+ * contend on one atomic index each and never take a lock.  Blocking
+ * calls spin briefly and then sleep on a futex; a push or pop only
+ * makes a wake syscall when some thread is actually sleeping.
+ *
+ * The capacity is the limit rounded up to a power of two, and at least
+ * 2 (a limit of 1 gives 2 slots).  Unlike gr_msg_queue, a limit of 0
+ * does not mean unbounded: the queue is always bounded, so 0 is
+ * rejected with std::invalid_argument.
+ * Timeouts are in seconds; a negative timeout waits forever.
+ *
+ * Instrumentation (depth watermark, latency histogram, blocked time)
+ * is off by default and enabled with set_instrumented().  It adds a
+ * timestamp per message and a few relaxed atomic updates, and can be
+ * read at any time with stats().  Drop and coalesce counters are
+ * always kept, since they are only touched when the queue is full.
+ *
+ * What insert_tail(msg) and handle(msg) do when the queue is full is
+ * selected per queue with set_overflow_policy():
+ *   GR_MSG_QUEUE_BLOCK          wait for space (the gr_msg_queue behaviour)
+ *   GR_MSG_QUEUE_BLOCK_TIMEOUT  wait up to the policy timeout, then drop the message
+ *   GR_MSG_QUEUE_DROP_NEWEST    drop the message being inserted
+ *   GR_MSG_QUEUE_DROP_OLDEST    discard the head to make room
+ *   GR_MSG_QUEUE_COALESCE       keep only the newest pending message per key
+ * Coalesced messages wait outside the ring, one per key (the message
+ * type unless set_coalesce_key() says otherwise), and move into the
+ * ring as consumers make room, after the messages already queued.
+ * try_insert_tail and the calls taking an explicit timeout are not
+ * affected by the policy.
+ */
+enum gr_msg_queue_overflow_t
+{
+    GR_MSG_QUEUE_BLOCK,
+    GR_MSG_QUEUE_BLOCK_TIMEOUT,
+    GR_MSG_QUEUE_DROP_NEWEST,
+    GR_MSG_QUEUE_DROP_OLDEST,
+    GR_MSG_QUEUE_COALESCE
+};
+
+class gr_mpmc_msg_queue : public gr::msg_handler, boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<gr_mpmc_msg_queue> sptr;
+
+    explicit gr_mpmc_msg_queue(unsigned int limit = 1024):
+        d_mask(round_up_pow2(limit) - 1),
+        d_cells(d_mask + 1),
+        d_enqueue_pos(0),
+        d_dequeue_pos(0),
+        d_instrumented(false),
+        d_policy(GR_MSG_QUEUE_BLOCK),
+        d_policy_timeout(0),
+        d_coalesce_key(&gr_mpmc_msg_queue::type_key),
+        d_stash_size(0),
+        d_enqueue_base(0),
+        d_dequeue_base(0)
+    {
+        reset_stats();
+        for (size_t i = 0; i < d_cells.size(); i++)
+        {
+            d_cells[i].seq.store(i, boost::memory_order_relaxed);
+        }
+    }
+
+    //! Same as insert_tail, for use as a gr::msg_handler
+    void handle(gr_message_sptr msg)
+    {
+        insert_tail(msg);
+    }
+
+    //! Select what insert_tail(msg) does when the queue is full
+    void set_overflow_policy(gr_msg_queue_overflow_t policy, double timeout = 0)
+    {
+        d_policy_timeout = timeout;
+        d_policy = policy;
+    }
+
+    //! Return the overflow policy
+    gr_msg_queue_overflow_t overflow_policy(void) const
+    {
+        return d_policy;
+    }
+
+    //! Set the function that returns a message's key for GR_MSG_QUEUE_COALESCE
+    void set_coalesce_key(long (*key)(const gr_message_sptr &))
+    {
+        d_coalesce_key = key;
+    }
+
+    //! Insert \p msg at the tail without blocking; false if the queue is full
+    bool try_insert_tail(const gr_message_sptr &msg)
+    {
+        return push_notify(msg);
+    }
+
+    /*!
+     * Insert \p msg at the tail, applying the overflow policy when the queue is full.
+     * With the default GR_MSG_QUEUE_BLOCK policy this blocks while the queue is full.
+     */
+    void insert_tail(const gr_message_sptr &msg)
+    {
+        switch (d_policy)
+        {
+        case GR_MSG_QUEUE_BLOCK:
+            insert_tail(msg, -1);
+            return;
+
+        case GR_MSG_QUEUE_BLOCK_TIMEOUT:
+            if (not insert_tail(msg, d_policy_timeout)) drop_newest(1);
+            return;
+
+        case GR_MSG_QUEUE_DROP_NEWEST:
+            if (not push_notify(msg)) drop_newest(1);
+            return;
+
+        case GR_MSG_QUEUE_DROP_OLDEST:
+            while (not push_notify(msg))
+            {
+                gr_message_sptr oldest;
+                if (try_pop(oldest)) d_dropped_oldest.fetch_add(1, boost::memory_order_relaxed);
+            }
+            return;
+
+        case GR_MSG_QUEUE_COALESCE:
+            if (d_stash_size.load(boost::memory_order_relaxed) == 0 and push_notify(msg)) return;
+            stash(msg);
+            drain_stash();
+            return;
+        }
+    }
+
+    //! Insert \p msg at the tail, waiting up to \p timeout for space; false on timeout
+    bool insert_tail(const gr_message_sptr &msg, double timeout)
+    {
+        const double deadline = gruel::monotonic_time() + timeout;
+        while (true)
+        {
+            if (push_notify(msg)) return true;
+            if (not wait(d_producers, deadline, timeout < 0, &gr_mpmc_msg_queue::full_p))
+            {
+                if (push_notify(msg)) return true;
+                d_timeouts.fetch_add(1, boost::memory_order_relaxed);
+                return false;
+            }
+        }
+    }
+
+    //! Remove and return the head, or a null sptr if the queue is empty
+    gr_message_sptr delete_head_nowait(void)
+    {
+        gr_message_sptr msg;
+        const bool popped = try_pop(msg);
+        if (d_stash_size.load(boost::memory_order_relaxed) != 0) drain_stash();
+        if (popped) notify(d_producers);
+        else if (d_stash_size.load(boost::memory_order_relaxed) != 0 and try_pop(msg)) notify(d_producers);
+        return msg;
+    }
+
+    //! Remove and return the head, blocking while the queue is empty
+    gr_message_sptr delete_head(void)
+    {
+        return delete_head(-1);
+    }
+
+    //! Remove and return the head, waiting up to \p timeout; null sptr on timeout
+    gr_message_sptr delete_head(double timeout)
+    {
+        const double deadline = gruel::monotonic_time() + timeout;
+        while (true)
+        {
+            gr_message_sptr msg = delete_head_nowait();
+            if (msg) return msg;
+            if (not wait(d_consumers, deadline, timeout < 0, &gr_mpmc_msg_queue::empty_p)) return delete_head_nowait();
+        }
+    }
+
+    /*!
+     * Insert \p msgs at the tail in order, waiting up to \p timeout for space.
+     * Sleeping consumers are woken once per batch rather than once per message.
+     * Returns the number of messages inserted, which is less than msgs.size() on timeout.
+     */
+    size_t insert_batch(const std::vector<gr_message_sptr> &msgs, double timeout = -1)
+    {
+        const double deadline = gruel::monotonic_time() + timeout;
+        bool timed_out = false;
+        size_t n = 0;
+        while (true)
+        {
+            const size_t first = n;
+            while (n < msgs.size() and try_push(msgs[n])) n++;
+            if (n != first) notify(d_consumers, int(n - first));
+            if (n == msgs.size()) return n;
+            if (timed_out)
+            {
+                d_timeouts.fetch_add(1, boost::memory_order_relaxed);
+                return n;
+            }
+            timed_out = not wait(d_producers, deadline, timeout < 0, &gr_mpmc_msg_queue::full_p);
+        }
+    }
+
+    /*!
+     * Remove up to \p max_n messages from the head in one handoff.
+     * Waits up to \p timeout for the first message, then takes whatever
+     * else is already queued without waiting again.  Returns an empty
+     * vector on timeout.
+     */
+    std::vector<gr_message_sptr> delete_head_batch(size_t max_n, double timeout = -1)
+    {
+        std::vector<gr_message_sptr> msgs;
+        const double deadline = gruel::monotonic_time() + timeout;
+        bool timed_out = false;
+        gr_message_sptr msg;
+        while (max_n != 0)
+        {
+            while (msgs.size() < max_n and try_pop(msg))
+            {
+                msgs.push_back(gr_message_sptr());
+                msgs.back().swap(msg);
+            }
+            if (d_stash_size.load(boost::memory_order_relaxed) != 0) drain_stash();
+            if (not msgs.empty()) notify(d_producers, int(msgs.size()));
+            if (not msgs.empty() or timed_out) break;
+            timed_out = not wait(d_consumers, deadline, timeout < 0, &gr_mpmc_msg_queue::empty_p);
+        }
+        return msgs;
+    }
+
+    //! Delete all messages from the queue
+    void flush(void)
+    {
+        while (delete_head_nowait()){}
+    }
+
+    //! Is the queue empty?
+    bool empty_p(void) const
+    {
+        return count() == 0;
+    }
+
+    //! Is the queue full?
+    bool full_p(void) const
+    {
+        return count() >= limit();
+    }
+
+    //! Return the approximate number of messages in the queue
+    unsigned int count(void) const
+    {
+        const size_t deq = d_dequeue_pos.load(boost::memory_order_relaxed);
+        const size_t enq = d_enqueue_pos.load(boost::memory_order_relaxed);
+        return (enq > deq)? (unsigned int)(enq - deq) : 0;
+    }
+
+    //! Return the capacity of the queue
+    unsigned int limit(void) const
+    {
+        return (unsigned int)(d_mask + 1);
+    }
+
+    //! Turn instrumentation on or off
+    void set_instrumented(bool enable)
+    {
+        d_instrumented.store(enable);
+    }
+
+    //! Is instrumentation on?
+    bool instrumented(void) const
+    {
+        return d_instrumented.load();
+    }
+
+    //! Return a snapshot of the instrumentation counters
+    gr_msg_queue_stats stats(void) const
+    {
+        gr_msg_queue_stats s;
+        s.depth = count();
+        s.high_watermark = d_high_watermark.load(boost::memory_order_relaxed);
+        s.limit = limit();
+        s.enqueued = d_enqueue_pos.load(boost::memory_order_relaxed) - d_enqueue_base.load(boost::memory_order_relaxed);
+        s.dropped_newest = d_dropped_newest.load(boost::memory_order_relaxed);
+        s.dropped_oldest = d_dropped_oldest.load(boost::memory_order_relaxed);
+        //DROP_OLDEST evictions also advance the dequeue position
+        const boost::uint64_t removed = d_dequeue_pos.load(boost::memory_order_relaxed) - d_dequeue_base.load(boost::memory_order_relaxed);
+        s.dequeued = removed - std::min(removed, s.dropped_oldest);
+        s.dropped = s.dropped_newest + s.dropped_oldest;
+        s.coalesced = d_coalesced.load(boost::memory_order_relaxed);
+        s.timeouts = d_timeouts.load(boost::memory_order_relaxed);
+        s.pending_coalesce = d_stash_size.load(boost::memory_order_relaxed);
+        s.producer_waits = d_producers.waits.load(boost::memory_order_relaxed);
+        s.consumer_waits = d_consumers.waits.load(boost::memory_order_relaxed);
+        s.producer_blocked = d_producers.blocked_ns.load(boost::memory_order_relaxed)*1e-9;
+        s.consumer_blocked = d_consumers.blocked_ns.load(boost::memory_order_relaxed)*1e-9;
+        s.latency_ns = d_latency.counts();
+        return s;
+    }
+
+    //! Zero the instrumentation counters
+    void reset_stats(void)
+    {
+        d_enqueue_base.store(d_enqueue_pos.load(), boost::memory_order_relaxed);
+        d_dequeue_base.store(d_dequeue_pos.load(), boost::memory_order_relaxed);
+        d_high_watermark.store(count());
+        d_dropped_newest.store(0);
+        d_dropped_oldest.store(0);
+        d_coalesced.store(0);
+        d_timeouts.store(0);
+        d_producers.waits.store(0);
+        d_producers.blocked_ns.store(0);
+        d_consumers.waits.store(0);
+        d_consumers.blocked_ns.store(0);
+        d_latency.reset();
+    }
+
+private:
+    //! Wait state for one side of the queue (producers or consumers)
+    struct side_t
+    {
+        side_t(void): sleepers(0), waits(0), blocked_ns(0){}
+        gruel::futex event;
+        boost::atomic<int> sleepers;
+        boost::atomic<boost::uint64_t> waits;
+        boost::atomic<boost::uint64_t> blocked_ns;
+    };
+
+    static long type_key(const gr_message_sptr &msg)
+    {
+        return msg->type();
+    }
+
+    bool push_notify(const gr_message_sptr &msg)
+    {
+        if (not try_push(msg)) return false;
+        notify(d_consumers);
+        return true;
+    }
+
+    void drop_newest(size_t n)
+    {
+        d_dropped_newest.fetch_add(n, boost::memory_order_relaxed);
+    }
+
+    //! Park \p msg outside the ring, replacing a pending message with the same key
+    void stash(const gr_message_sptr &msg)
+    {
+        const long key = d_coalesce_key(msg);
+        GRUEL_PROFILED_LOCK(lock, d_stash_mutex);
+        gr_message_sptr &slot = d_stash[key];
+        if (slot) d_coalesced.fetch_add(1, boost::memory_order_relaxed);
+        slot = msg;
+        d_stash_size.store(d_stash.size());
+    }
+
+    //! Move parked messages into the ring while there is room
+    void drain_stash(void)
+    {
+        GRUEL_PROFILED_LOCK(lock, d_stash_mutex);
+        while (not d_stash.empty() and push_notify(d_stash.begin()->second))
+        {
+            d_stash.erase(d_stash.begin());
+        }
+        d_stash_size.store(d_stash.size());
+    }
+
+    //! Smallest power of two >= n, and at least 2 (one slot cannot tell full from empty)
+    static size_t round_up_pow2(size_t n)
+    {
+        if (n == 0) throw std::invalid_argument("gr_mpmc_msg_queue: limit must be non-zero (the queue is always bounded)");
+        size_t p = 2;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    bool try_push(const gr_message_sptr &msg)
+    {
+        size_t pos = d_enqueue_pos.load(boost::memory_order_relaxed);
+        cell_t *cell;
+        while (true)
+        {
+            cell = &d_cells[pos & d_mask];
+            const size_t seq = cell->seq.load(boost::memory_order_acquire);
+            const ptrdiff_t dif = ptrdiff_t(seq) - ptrdiff_t(pos);
+            if (dif == 0)
+            {
+                if (d_enqueue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+            }
+            else if (dif < 0) return false;
+            else pos = d_enqueue_pos.load(boost::memory_order_relaxed);
+        }
+        cell->msg = msg;
+        if (d_instrumented.load(boost::memory_order_relaxed))
+        {
+            cell->stamp = gruel::monotonic_ns();
+            const size_t depth = pos + 1 - d_dequeue_pos.load(boost::memory_order_relaxed);
+            size_t hwm = d_high_watermark.load(boost::memory_order_relaxed);
+            while (depth > hwm and not d_high_watermark.compare_exchange_weak(hwm, depth, boost::memory_order_relaxed)){}
+        }
+        else cell->stamp = 0;
+        cell->seq.store(pos + 1, boost::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(gr_message_sptr &msg)
+    {
+        size_t pos = d_dequeue_pos.load(boost::memory_order_relaxed);
+        cell_t *cell;
+        while (true)
+        {
+            cell = &d_cells[pos & d_mask];
+            const size_t seq = cell->seq.load(boost::memory_order_acquire);
+            const ptrdiff_t dif = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+            if (dif == 0)
+            {
+                if (d_dequeue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+            }
+            else if (dif < 0) return false;
+            else pos = d_dequeue_pos.load(boost::memory_order_relaxed);
+        }
+        msg.swap(cell->msg);
+        if (cell->stamp != 0 and d_instrumented.load(boost::memory_order_relaxed))
+        {
+            d_latency.add(gruel::monotonic_ns() - cell->stamp);
+        }
+        cell->seq.store(pos + d_mask + 1, boost::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * Wake up to \p count sleepers, if there are any.  The fence orders the preceding
+     * push or pop before the sleeper check; a waiter registers before it
+     * re-checks the queue, so one of the two always sees the other.
+     */
+    static void notify(side_t &side, int count = 1)
+    {
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        if (side.sleepers.load(boost::memory_order_relaxed) == 0) return;
+        side.event.value().fetch_add(1, boost::memory_order_seq_cst);
+        side.event.wake(count);
+    }
+
+    /*!
+     * Wait for the event word to change while blocked_p() holds.
+     * Spins first, then registers as a sleeper and re-checks before
+     * sleeping so a notify between the check and the sleep is not lost.
+     * Returns false once the deadline has passed.
+     */
+    bool wait(side_t &side, double deadline, bool forever, bool (gr_mpmc_msg_queue::*blocked_p)(void) const)
+    {
+        for (size_t i = 0; i < 128; i++)
+        {
+            if (not (this->*blocked_p)()) return true;
+            gruel::cpu_relax();
+        }
+
+        const int key = side.event.value().load(boost::memory_order_seq_cst);
+        side.sleepers.fetch_add(1, boost::memory_order_seq_cst);
+        //pairs with the fence in notify(): blocked_p() loads are relaxed
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        bool ok = true;
+        if ((this->*blocked_p)())
+        {
+            const bool instrumented = d_instrumented.load(boost::memory_order_relaxed);
+            const boost::uint64_t t0 = instrumented? gruel::monotonic_ns() : 0;
+            if (forever) side.event.wait(key);
+            else
+            {
+                const double remaining = deadline - gruel::monotonic_time();
+                ok = remaining > 0 and side.event.wait(key, remaining);
+            }
+            if (instrumented)
+            {
+                side.waits.fetch_add(1, boost::memory_order_relaxed);
+                side.blocked_ns.fetch_add(gruel::monotonic_ns() - t0, boost::memory_order_relaxed);
+            }
+        }
+        side.sleepers.fetch_sub(1, boost::memory_order_seq_cst);
+        return ok;
+    }
+
+    struct cell_t
+    {
+        cell_t(void): seq(0), stamp(0){}
+        cell_t(const cell_t &): seq(0), stamp(0){}
+        boost::atomic<size_t> seq;
+        gr_message_sptr msg;
+        boost::uint64_t stamp;
+    };
+
+    //pad the hot indexes onto their own cache lines
+    const size_t d_mask;
+    std::vector<cell_t> d_cells;
+    char d_pad0[64];
+    boost::atomic<size_t> d_enqueue_pos;
+    char d_pad1[64];
+    boost::atomic<size_t> d_dequeue_pos;
+    char d_pad2[64];
+    side_t d_consumers;
+    side_t d_producers;
+    boost::atomic<bool> d_instrumented;
+    boost::atomic<size_t> d_high_watermark;
+    boost::atomic<boost::uint64_t> d_dropped_newest;
+    boost::atomic<boost::uint64_t> d_dropped_oldest;
+    boost::atomic<boost::uint64_t> d_coalesced;
+    boost::atomic<boost::uint64_t> d_timeouts;
+    gr_msg_queue_overflow_t d_policy;
+    double d_policy_timeout;
+    long (*d_coalesce_key)(const gr_message_sptr &);
+    gruel::mutex d_stash_mutex;
+    std::map<long, gr_message_sptr> d_stash;
+    boost::atomic<size_t> d_stash_size;
+    boost::atomic<size_t> d_enqueue_base;
+    boost::atomic<size_t> d_dequeue_base;
+    gruel::log2_histogram d_latency;
+};
+
+typedef gr_mpmc_msg_queue::sptr gr_mpmc_msg_queue_sptr;
+
+static inline gr_mpmc_msg_queue_sptr gr_make_mpmc_msg_queue(unsigned int limit = 1024)
+{
+    return gr_mpmc_msg_queue_sptr(new gr_mpmc_msg_queue(limit));
+}
+
+#endif //GNURADIO_GR_MPMC_MSG_QUEUE_H
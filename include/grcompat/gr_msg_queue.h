@@ -4,10 +4,54 @@
 #define GNURADIO_GR_MSG_QUEUE_H
 
 #include <gnuradio/msg_queue.h>
+#include <gr_message.h>
+#include <gruel/futex.h>
+#include <boost/thread/thread.hpp>
+#include <vector>
 
 typedef gr::msg_queue gr_msg_queue;
 typedef gr::msg_queue::sptr gr_msg_queue_sptr;
 
+/*!
+ * Insert \p msgs at the tail of \p q in order, blocking while it is full.
+ * gr::msg_queue takes its lock once per message; see gr_mpmc_msg_queue
+ * for a queue that hands off a whole batch per wakeup.
+ */
+static inline size_t gr_msg_queue_insert_batch(gr_msg_queue_sptr q, const std::vector<gr_message_sptr> &msgs)
+{
+    for (size_t i = 0; i < msgs.size(); i++) q->insert_tail(msgs[i]);
+    return msgs.size();
+}
+
+/*!
+ * Remove up to \p max_n messages from the head of \p q.
+ * Waits up to \p timeout seconds for the first message (forever when
+ * negative), then takes whatever else is queued without waiting.
+ * gr::msg_queue has no timed wait, so a finite timeout is polled.
+ */
+static inline std::vector<gr_message_sptr> gr_msg_queue_delete_head_batch(gr_msg_queue_sptr q, size_t max_n, double timeout = -1)
+{
+    std::vector<gr_message_sptr> msgs;
+    if (max_n == 0) return msgs;
+
+    gr_message_sptr msg = q->delete_head_nowait();
+    if (not msg and timeout < 0) msg = q->delete_head();
+    const double deadline = gruel::monotonic_time() + timeout;
+    while (not msg and gruel::monotonic_time() < deadline)
+    {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+        msg = q->delete_head_nowait();
+    }
+
+    while (msg)
+    {
+        msgs.push_back(msg);
+        if (msgs.size() == max_n) break;
+        msg = q->delete_head_nowait();
+    }
+    return msgs;
+}
+
 #endif //GNURADIO_GR_MSG_QUEUE_H
 
 #warning GR-COMPAT REQUIRED TO COMPILE - OUTDATED GNURADIO API IN USE - PLEASE UPDATE YOUR MODULE!!!
@@ -0,0 +1,79 @@
+//What gets measured gets managed
+
+#ifndef GNURADIO_GR_MSG_QUEUE_STATS_H
+#define GNURADIO_GR_MSG_QUEUE_STATS_H
+
+#include <gruel/histogram.h>
+#include <boost/cstdint.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Snapshot of a message queue's instrumentation counters.
+ *
+ * Latencies are measured from enqueue to dequeue and kept in
+ * power-of-two nanosecond buckets (see gruel::log2_histogram).
+ */
+struct gr_msg_queue_stats
+{
+    gr_msg_queue_stats(void):
+        depth(0), high_watermark(0), limit(0),
+        enqueued(0), dequeued(0), dropped(0),
+        dropped_newest(0), dropped_oldest(0), coalesced(0), timeouts(0), pending_coalesce(0),
+        producer_waits(0), consumer_waits(0),
+        producer_blocked(0), consumer_blocked(0)
+    {}
+
+    size_t depth; //!< messages in the queue when the snapshot was taken
+    size_t high_watermark; //!< largest depth seen since the last reset
+    size_t limit; //!< capacity of the queue
+    boost::uint64_t enqueued; //!< messages inserted
+    boost::uint64_t dequeued; //!< messages taken by consumers (so enqueued - dequeued - dropped_oldest == depth)
+    boost::uint64_t dropped; //!< messages the queue discarded (newest + oldest)
+    boost::uint64_t dropped_newest; //!< messages discarded because the queue was full (GR_MSG_QUEUE_DROP_NEWEST, GR_MSG_QUEUE_BLOCK_TIMEOUT)
+    boost::uint64_t dropped_oldest; //!< queued messages discarded to make room (GR_MSG_QUEUE_DROP_OLDEST)
+    boost::uint64_t coalesced; //!< pending messages replaced by a newer one with the same key
+    boost::uint64_t timeouts; //!< inserts that gave up after waiting for space
+    size_t pending_coalesce; //!< messages parked outside the ring waiting for room
+    boost::uint64_t producer_waits; //!< times a producer went to sleep on a full queue
+    boost::uint64_t consumer_waits; //!< times a consumer went to sleep on an empty queue
+    double producer_blocked; //!< total seconds producers spent asleep
+    double consumer_blocked; //!< total seconds consumers spent asleep
+    std::vector<boost::uint64_t> latency_ns; //!< enqueue-to-dequeue latency histogram
+
+    //! Estimate a latency quantile (0..1) in nanoseconds
+    boost::uint64_t latency_quantile(double q) const
+    {
+        return gruel::log2_histogram::quantile(latency_ns, q);
+    }
+
+    //! Format the snapshot as a JSON object
+    std::string to_json(void) const
+    {
+        std::ostringstream ss;
+        ss << "{";
+        ss << "\"depth\": " << depth;
+        ss << ", \"high_watermark\": " << high_watermark;
+        ss << ", \"limit\": " << limit;
+        ss << ", \"enqueued\": " << enqueued;
+        ss << ", \"dequeued\": " << dequeued;
+        ss << ", \"dropped\": " << dropped;
+        ss << ", \"dropped_newest\": " << dropped_newest;
+        ss << ", \"dropped_oldest\": " << dropped_oldest;
+        ss << ", \"coalesced\": " << coalesced;
+        ss << ", \"timeouts\": " << timeouts;
+        ss << ", \"pending_coalesce\": " << pending_coalesce;
+        ss << ", \"producer_waits\": " << producer_waits;
+        ss << ", \"consumer_waits\": " << consumer_waits;
+        ss << ", \"producer_blocked_s\": " << producer_blocked;
+        ss << ", \"consumer_blocked_s\": " << consumer_blocked;
+        ss << ", \"latency_p50_ns\": " << latency_quantile(0.5);
+        ss << ", \"latency_p99_ns\": " << latency_quantile(0.99);
+        ss << ", \"latency_log2_ns\": " << gruel::log2_histogram::to_json(latency_ns);
+        ss << "}";
+        return ss.str();
+    }
+};
+
+#endif //GNURADIO_GR_MSG_QUEUE_STATS_H
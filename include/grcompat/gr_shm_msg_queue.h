@@ -0,0 +1,406 @@
+//Sharing is caring
+
+#ifndef GNURADIO_GR_SHM_MSG_QUEUE_H
+#define GNURADIO_GR_SHM_MSG_QUEUE_H
+
+#include <gr_message.h>
+#include <gruel/futex.h>
+#include <gruel/pmt.h>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <stdexcept>
+#include <cstring>
+#include <string>
+#include <new>
+
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_LLONG_LOCK_FREE == 2 and BOOST_ATOMIC_INT_LOCK_FREE == 2);
+
+/*!
+ * \brief Message queue between processes on the same host.
+ *
+ * The queue lives in a named POSIX shared memory object: a ring of
+ * fixed-size slots, each with its own sequence number, claimed with
+ * lock-free compare-and-swap from either process (the same protocol
+ * as gr_mpmc_msg_queue).  Blocked producers and consumers sleep on
+ * process-shared futexes, so a message costs two copies (into the slot
+ * and out of it) and a wake syscall only when the other side sleeps.
+ * Non-Linux hosts poll instead of sleeping on a futex.
+ *
+ * One process calls create(), the others call open() with the same
+ * name.  create() fails if the name is already taken, so a second
+ * creator cannot detach live peers; a queue left behind by a process
+ * that crashed is cleared with remove().  The creator removes the name
+ * when it is destroyed.  Payloads larger than the slot size given to
+ * create() are rejected.
+ *
+ * pmt objects are carried as messages whose payload is the pmt
+ * serialized with pmt_serialize_str.
+ */
+class gr_shm_msg_queue : boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<gr_shm_msg_queue> sptr;
+
+    /*!
+     * Create the queue \p name with \p limit slots of \p max_payload bytes.
+     * Throws boost::interprocess::interprocess_exception if \p name exists.
+     */
+    static sptr create(const std::string &name, unsigned int limit, size_t max_payload)
+    {
+        return sptr(new gr_shm_msg_queue(name, limit, max_payload));
+    }
+
+    //! Open the queue \p name that another process created
+    static sptr open(const std::string &name)
+    {
+        return sptr(new gr_shm_msg_queue(name));
+    }
+
+    /*!
+     * Remove the name \p name, e.g. a stale queue left by a crashed process.
+     * Processes that still have it open keep their mapping, but nobody new
+     * can open it.  Returns false if there was nothing to remove.
+     */
+    static bool remove(const std::string &name)
+    {
+        return boost::interprocess::shared_memory_object::remove(name.c_str());
+    }
+
+    ~gr_shm_msg_queue(void)
+    {
+        if (d_owner) boost::interprocess::shared_memory_object::remove(d_name.c_str());
+    }
+
+    //! Insert \p msg at the tail without blocking; false if the queue is full
+    bool try_insert_tail(const gr_message_sptr &msg)
+    {
+        if (msg->length() > d_slot_size) throw std::runtime_error("gr_shm_msg_queue: message larger than slot");
+        if (not try_push(*msg)) return false;
+        notify(d_hdr->not_empty, d_hdr->sleeping_consumers);
+        return true;
+    }
+
+    //! Insert \p msg at the tail, blocking while the queue is full
+    void insert_tail(const gr_message_sptr &msg)
+    {
+        insert_tail(msg, -1);
+    }
+
+    //! Insert \p msg at the tail, waiting up to \p timeout for space; false on timeout
+    bool insert_tail(const gr_message_sptr &msg, double timeout)
+    {
+        const double deadline = gruel::monotonic_time() + timeout;
+        while (true)
+        {
+            if (try_insert_tail(msg)) return true;
+            if (not wait(d_hdr->not_full, d_hdr->sleeping_producers, deadline, timeout < 0, &gr_shm_msg_queue::full_p)) return try_insert_tail(msg);
+        }
+    }
+
+    //! Remove and return the head, or a null sptr if the queue is empty
+    gr_message_sptr delete_head_nowait(void)
+    {
+        gr_message_sptr msg = try_pop();
+        if (msg) notify(d_hdr->not_full, d_hdr->sleeping_producers);
+        return msg;
+    }
+
+    //! Remove and return the head, blocking while the queue is empty
+    gr_message_sptr delete_head(void)
+    {
+        return delete_head(-1);
+    }
+
+    //! Remove and return the head, waiting up to \p timeout; null sptr on timeout
+    gr_message_sptr delete_head(double timeout)
+    {
+        const double deadline = gruel::monotonic_time() + timeout;
+        while (true)
+        {
+            gr_message_sptr msg = delete_head_nowait();
+            if (msg) return msg;
+            if (not wait(d_hdr->not_empty, d_hdr->sleeping_consumers, deadline, timeout < 0, &gr_shm_msg_queue::empty_p)) return delete_head_nowait();
+        }
+    }
+
+    //! Serialize \p obj and insert it at the tail, waiting up to \p timeout; false on timeout
+    bool insert_tail_pmt(const pmt::pmt_t &obj, long type = 0, double timeout = -1)
+    {
+        return insert_tail(gr_make_message_from_string(pmt::pmt_serialize_str(obj), type), timeout);
+    }
+
+    //! Remove the head and deserialize it as a pmt; PMT_EOF on timeout
+    pmt::pmt_t delete_head_pmt(double timeout = -1)
+    {
+        gr_message_sptr msg = delete_head(timeout);
+        if (not msg) return pmt::PMT_EOF;
+        return pmt::pmt_deserialize_str(msg->to_string());
+    }
+
+    //! Delete all messages from the queue
+    void flush(void)
+    {
+        while (delete_head_nowait()){}
+    }
+
+    //! Is the queue empty?
+    bool empty_p(void) const
+    {
+        return count() == 0;
+    }
+
+    //! Is the queue full?
+    bool full_p(void) const
+    {
+        return count() >= limit();
+    }
+
+    //! Return the approximate number of messages in the queue
+    unsigned int count(void) const
+    {
+        const boost::uint64_t deq = d_hdr->dequeue_pos.load(boost::memory_order_relaxed);
+        const boost::uint64_t enq = d_hdr->enqueue_pos.load(boost::memory_order_relaxed);
+        return (enq > deq)? (unsigned int)(enq - deq) : 0;
+    }
+
+    //! Return the number of slots
+    unsigned int limit(void) const
+    {
+        return (unsigned int)(d_mask + 1);
+    }
+
+    //! Return the largest payload a message may carry
+    size_t max_payload(void) const
+    {
+        return size_t(d_slot_size);
+    }
+
+    //! Return the shared memory name
+    const std::string &name(void) const
+    {
+        return d_name;
+    }
+
+private:
+    enum {MAGIC = 0x67727368, VERSION = 1};
+
+    struct header_t
+    {
+        boost::atomic<boost::uint32_t> magic;
+        boost::uint32_t version;
+        boost::uint64_t mask;
+        boost::uint64_t slot_size;
+        boost::uint64_t slot_stride;
+        char pad0[64];
+        boost::atomic<boost::uint64_t> enqueue_pos;
+        char pad1[64];
+        boost::atomic<boost::uint64_t> dequeue_pos;
+        char pad2[64];
+        boost::atomic<int> not_empty;
+        boost::atomic<int> not_full;
+        boost::atomic<int> sleeping_consumers;
+        boost::atomic<int> sleeping_producers;
+    };
+
+    struct slot_t
+    {
+        boost::atomic<boost::uint64_t> seq;
+        boost::int64_t type;
+        double arg1;
+        double arg2;
+        boost::uint64_t length;
+        //payload follows
+    };
+
+    static size_t round_up_pow2(size_t n)
+    {
+        size_t p = 2;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    gr_shm_msg_queue(const std::string &name, unsigned int limit, size_t max_payload):
+        d_name(name), d_owner(true)
+    {
+        using namespace boost::interprocess;
+        d_shm = shared_memory_object(create_only, name.c_str(), read_write);
+
+        const size_t nslots = round_up_pow2(limit);
+        const size_t stride = (sizeof(slot_t) + max_payload + 63) & ~size_t(63);
+        d_shm.truncate(offset_t(sizeof(header_t) + nslots*stride));
+        d_region = mapped_region(d_shm, read_write);
+
+        d_hdr = new (d_region.get_address()) header_t();
+        d_hdr->version = VERSION;
+        d_hdr->mask = d_mask = nslots - 1;
+        d_hdr->slot_size = d_slot_size = max_payload;
+        d_hdr->slot_stride = d_slot_stride = stride;
+        d_hdr->enqueue_pos.store(0);
+        d_hdr->dequeue_pos.store(0);
+        d_hdr->not_empty.store(0);
+        d_hdr->not_full.store(0);
+        d_hdr->sleeping_consumers.store(0);
+        d_hdr->sleeping_producers.store(0);
+        for (size_t i = 0; i < nslots; i++)
+        {
+            slot_t *s = new (slot(i)) slot_t();
+            s->seq.store(i, boost::memory_order_relaxed);
+        }
+        d_hdr->magic.store(MAGIC, boost::memory_order_release);
+    }
+
+    explicit gr_shm_msg_queue(const std::string &name):
+        d_name(name), d_owner(false)
+    {
+        using namespace boost::interprocess;
+        d_shm = shared_memory_object(open_only, name.c_str(), read_write);
+        d_region = mapped_region(d_shm, read_write);
+        d_hdr = static_cast<header_t *>(d_region.get_address());
+        if (d_region.get_size() < sizeof(header_t) or
+            d_hdr->magic.load(boost::memory_order_acquire) != MAGIC or
+            d_hdr->version != VERSION)
+        {
+            throw std::runtime_error("gr_shm_msg_queue: " + name + " is not an initialized queue");
+        }
+
+        //the geometry comes from another process: check it against the mapping,
+        //then keep a private copy so later changes to the header cannot move slot()
+        const boost::uint64_t nslots = d_hdr->mask + 1;
+        const boost::uint64_t stride = d_hdr->slot_stride;
+        const boost::uint64_t max_payload = d_hdr->slot_size;
+        const size_t room = d_region.get_size() - sizeof(header_t);
+        if (nslots < 2 or (nslots & (nslots - 1)) != 0 or
+            stride < sizeof(slot_t) or stride % sizeof(boost::uint64_t) != 0 or
+            max_payload > stride - sizeof(slot_t) or
+            nslots > room/stride)
+        {
+            throw std::runtime_error("gr_shm_msg_queue: " + name + " has a corrupt header");
+        }
+        d_mask = nslots - 1;
+        d_slot_size = max_payload;
+        d_slot_stride = stride;
+    }
+
+    slot_t *slot(boost::uint64_t pos) const
+    {
+        char *base = static_cast<char *>(d_region.get_address()) + sizeof(header_t);
+        return reinterpret_cast<slot_t *>(base + (pos & d_mask)*d_slot_stride);
+    }
+
+    static unsigned char *payload(slot_t *s)
+    {
+        return reinterpret_cast<unsigned char *>(s + 1);
+    }
+
+    bool try_push(const gr_message &msg)
+    {
+        boost::uint64_t pos = d_hdr->enqueue_pos.load(boost::memory_order_relaxed);
+        slot_t *s;
+        while (true)
+        {
+            s = slot(pos);
+            const boost::uint64_t seq = s->seq.load(boost::memory_order_acquire);
+            const boost::int64_t dif = boost::int64_t(seq - pos);
+            if (dif == 0)
+            {
+                if (d_hdr->enqueue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+            }
+            else if (dif < 0) return false;
+            else pos = d_hdr->enqueue_pos.load(boost::memory_order_relaxed);
+        }
+        s->type = msg.type();
+        s->arg1 = msg.arg1();
+        s->arg2 = msg.arg2();
+        s->length = msg.length();
+        if (msg.length() != 0) std::memcpy(payload(s), msg.msg(), msg.length());
+        s->seq.store(pos + 1, boost::memory_order_release);
+        return true;
+    }
+
+    gr_message_sptr try_pop(void)
+    {
+        boost::uint64_t pos = d_hdr->dequeue_pos.load(boost::memory_order_relaxed);
+        slot_t *s;
+        while (true)
+        {
+            s = slot(pos);
+            const boost::uint64_t seq = s->seq.load(boost::memory_order_acquire);
+            const boost::int64_t dif = boost::int64_t(seq - (pos + 1));
+            if (dif == 0)
+            {
+                if (d_hdr->dequeue_pos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) break;
+            }
+            else if (dif < 0) return gr_message_sptr();
+            else pos = d_hdr->dequeue_pos.load(boost::memory_order_relaxed);
+        }
+        const boost::uint64_t length = s->length;
+        gr_message_sptr msg;
+        if (length <= d_slot_size) msg = gr_make_message_from_buffer(payload(s), size_t(length), long(s->type), s->arg1, s->arg2);
+        s->seq.store(pos + d_mask + 1, boost::memory_order_release);
+        if (not msg) throw std::runtime_error("gr_shm_msg_queue: corrupt message length in " + d_name);
+        return msg;
+    }
+
+    //! Wake one sleeper in either process, if there is any (see gr_mpmc_msg_queue::notify)
+    static void notify(boost::atomic<int> &event, boost::atomic<int> &sleepers)
+    {
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        if (sleepers.load(boost::memory_order_relaxed) == 0) return;
+        event.fetch_add(1, boost::memory_order_seq_cst);
+        #ifdef __linux__
+        gruel::futex_wake(reinterpret_cast<int *>(&event), 1, true);
+        #endif
+    }
+
+    //! Sleep until notified while blocked_p() holds; false once the deadline has passed
+    bool wait(boost::atomic<int> &event, boost::atomic<int> &sleepers,
+        double deadline, bool forever, bool (gr_shm_msg_queue::*blocked_p)(void) const)
+    {
+        for (size_t i = 0; i < 128; i++)
+        {
+            if (not (this->*blocked_p)()) return true;
+            gruel::cpu_relax();
+        }
+
+        const int key = event.load(boost::memory_order_seq_cst);
+        sleepers.fetch_add(1, boost::memory_order_seq_cst);
+        //pairs with the fence in notify(): blocked_p() loads are relaxed
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        bool ok = true;
+        if ((this->*blocked_p)())
+        {
+            const double remaining = forever? -1 : deadline - gruel::monotonic_time();
+            if (not forever and remaining <= 0) ok = false;
+            else
+            {
+                #ifdef __linux__
+                ok = gruel::futex_wait(reinterpret_cast<int *>(&event), key, remaining, true);
+                #else
+                boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+                ok = forever or gruel::monotonic_time() < deadline;
+                #endif
+            }
+        }
+        sleepers.fetch_sub(1, boost::memory_order_seq_cst);
+        return ok;
+    }
+
+    const std::string d_name;
+    const bool d_owner;
+    boost::interprocess::shared_memory_object d_shm;
+    boost::interprocess::mapped_region d_region;
+    header_t *d_hdr;
+    boost::uint64_t d_mask;
+    boost::uint64_t d_slot_size;
+    boost::uint64_t d_slot_stride;
+};
+
+typedef gr_shm_msg_queue::sptr gr_shm_msg_queue_sptr;
+
+#endif //GNURADIO_GR_SHM_MSG_QUEUE_H
@@ -0,0 +1,228 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_EVENT_H
+#define INCLUDED_GRUEL_EVENT_H
+
+#include <gruel/futex.h>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <climits>
+
+/*!
+ * Signalling primitives built directly on gruel::futex.
+ *
+ * Unlike a condition_variable these need no mutex: signalling is one
+ * atomic operation, plus a wake syscall only when a thread is asleep.
+ * Waiters poll for a short spin phase before sleeping, which catches
+ * signals that arrive within a few microseconds without a context
+ * switch.
+ *
+ * Timeouts are relative and in seconds; a negative timeout waits forever.
+ */
+
+namespace gruel
+{
+
+namespace event_detail {
+
+    //! Remaining time until \p deadline, or -1 when waiting forever
+    inline double remaining(double deadline, bool forever)
+    {
+        if (forever) return -1;
+        const double left = deadline - monotonic_time();
+        return left > 0? left : 0;
+    }
+
+} //namespace event_detail
+
+    /*!
+     * \brief Binary event flag.
+     *
+     * A manual-reset event stays set, releasing every waiter, until
+     * reset() is called.  An auto-reset event releases one waiter per
+     * set() and clears itself.
+     */
+    class event : boost::noncopyable
+    {
+    public:
+        explicit event(bool auto_reset = false, bool initially_set = false, unsigned spin = 100):
+            d_auto_reset(auto_reset),
+            d_spin(spin),
+            d_state(initially_set? 1 : 0),
+            d_sleepers(0)
+        {}
+
+        //! Set the event and wake waiters
+        void set(void)
+        {
+            d_state.value().exchange(1);
+            if (d_sleepers.load() != 0) d_state.wake(d_auto_reset? 1 : INT_MAX);
+        }
+
+        //! Clear the event
+        void reset(void)
+        {
+            d_state.value().store(0);
+        }
+
+        //! Is the event set? (consumes it for an auto-reset event)
+        bool try_wait(void)
+        {
+            if (not d_auto_reset) return d_state.value().load(boost::memory_order_acquire) == 1;
+            int s = 1;
+            return d_state.value().compare_exchange_strong(s, 0, boost::memory_order_acquire);
+        }
+
+        //! Wait until the event is set; returns false on timeout
+        bool wait(double timeout = -1)
+        {
+            for (unsigned i = 0; i < d_spin; i++)
+            {
+                if (try_wait()) return true;
+                cpu_relax();
+            }
+
+            const double deadline = monotonic_time() + timeout;
+            d_sleepers.fetch_add(1);
+            bool ok = true;
+            while (not try_wait())
+            {
+                const double left = event_detail::remaining(deadline, timeout < 0);
+                if (left == 0 or not d_state.wait(0, left))
+                {
+                    ok = try_wait();
+                    break;
+                }
+            }
+            d_sleepers.fetch_sub(1);
+            return ok;
+        }
+
+    private:
+        const bool d_auto_reset;
+        const unsigned d_spin;
+        futex d_state;
+        boost::atomic<int> d_sleepers;
+    };
+
+    //! Counting semaphore
+    class semaphore : boost::noncopyable
+    {
+    public:
+        explicit semaphore(int initial = 0, unsigned spin = 100):
+            d_spin(spin),
+            d_count(initial),
+            d_sleepers(0)
+        {}
+
+        //! Add \p n to the count, waking up to \p n waiters
+        void post(int n = 1)
+        {
+            d_count.value().fetch_add(n);
+            if (d_sleepers.load() != 0) d_count.wake(n);
+        }
+
+        //! Take one from the count if it is positive
+        bool try_wait(void)
+        {
+            int c = d_count.value().load(boost::memory_order_relaxed);
+            while (c > 0)
+            {
+                if (d_count.value().compare_exchange_weak(c, c - 1, boost::memory_order_acquire)) return true;
+            }
+            return false;
+        }
+
+        //! Wait for the count to become positive and take one; returns false on timeout
+        bool wait(double timeout = -1)
+        {
+            for (unsigned i = 0; i < d_spin; i++)
+            {
+                if (try_wait()) return true;
+                cpu_relax();
+            }
+
+            const double deadline = monotonic_time() + timeout;
+            d_sleepers.fetch_add(1);
+            bool ok = true;
+            while (not try_wait())
+            {
+                const double left = event_detail::remaining(deadline, timeout < 0);
+                if (left == 0 or not d_count.wait(0, left))
+                {
+                    ok = try_wait();
+                    break;
+                }
+            }
+            d_sleepers.fetch_sub(1);
+            return ok;
+        }
+
+        //! Return the current count
+        int count(void)
+        {
+            return d_count.value().load(boost::memory_order_relaxed);
+        }
+
+    private:
+        const unsigned d_spin;
+        futex d_count;
+        boost::atomic<int> d_sleepers;
+    };
+
+    //! One-shot latch: waiters are released once count_down() brings the count to zero
+    class latch : boost::noncopyable
+    {
+    public:
+        explicit latch(int count, unsigned spin = 100):
+            d_spin(spin),
+            d_count(count)
+        {}
+
+        //! Subtract \p n from the count; the call that reaches (or passes) zero wakes every waiter
+        void count_down(int n = 1)
+        {
+            const int old = d_count.value().fetch_sub(n, boost::memory_order_release);
+            if (old > 0 and old - n <= 0) d_count.wake();
+        }
+
+        //! Has the count reached zero?
+        bool try_wait(void)
+        {
+            return d_count.value().load(boost::memory_order_acquire) <= 0;
+        }
+
+        //! Wait for the count to reach zero; returns false on timeout
+        bool wait(double timeout = -1)
+        {
+            for (unsigned i = 0; i < d_spin; i++)
+            {
+                if (try_wait()) return true;
+                cpu_relax();
+            }
+
+            const double deadline = monotonic_time() + timeout;
+            while (true)
+            {
+                const int c = d_count.value().load(boost::memory_order_acquire);
+                if (c <= 0) return true;
+                const double left = event_detail::remaining(deadline, timeout < 0);
+                if (left == 0 or not d_count.wait(c, left)) return try_wait();
+            }
+        }
+
+        //! count_down() then wait()
+        void arrive_and_wait(void)
+        {
+            count_down();
+            wait();
+        }
+
+    private:
+        const unsigned d_spin;
+        futex d_count;
+    };
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_EVENT_H
@@ -0,0 +1,157 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_FUTEX_H
+#define INCLUDED_GRUEL_FUTEX_H
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <climits>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include <cerrno>
+#else
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#endif
+
+/*!
+ * A 32-bit wait/wake word.
+ *
+ * On Linux, wait() and wake() go straight to the futex syscall, so a
+ * wake with no sleepers is just an atomic operation and a wakeup is a
+ * single syscall.  Other platforms fall back to a mutex and condition
+ * variable with the same semantics.
+ *
+ * Timeouts are relative and in seconds; a negative timeout waits forever.
+ */
+
+namespace gruel
+{
+
+    //! Monotonic time in seconds, for computing wait deadlines
+    inline double monotonic_time(void)
+    {
+        return boost::chrono::duration<double>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //! Monotonic time in nanoseconds, for timestamps and durations
+    inline boost::uint64_t monotonic_ns(void)
+    {
+        return boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //! Tell the CPU the caller is busy-waiting (pause/yield hint)
+    inline void cpu_relax(void)
+    {
+        #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+        __builtin_ia32_pause();
+        #elif defined(__GNUC__) && defined(__aarch64__)
+        __asm__ __volatile__("yield");
+        #endif
+    }
+
+#ifdef __linux__
+
+    /*!
+     * Sleep while *addr == expected, until woken or \p timeout elapses.
+     * Set \p shared for words that live in memory shared between processes.
+     * Returns false on timeout.
+     */
+    inline bool futex_wait(int *addr, int expected, double timeout = -1, bool shared = false)
+    {
+        struct timespec ts, *tsp = NULL;
+        if (timeout >= 0)
+        {
+            ts.tv_sec = time_t(timeout);
+            ts.tv_nsec = long((timeout - double(ts.tv_sec))*1e9);
+            tsp = &ts;
+        }
+        const int op = shared? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+        const long r = syscall(SYS_futex, addr, op, expected, tsp, NULL, 0);
+        return not (r == -1 and errno == ETIMEDOUT);
+    }
+
+    //! Wake up to \p count waiters sleeping on \p addr
+    inline void futex_wake(int *addr, int count = INT_MAX, bool shared = false)
+    {
+        const int op = shared? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+        syscall(SYS_futex, addr, op, count, NULL, NULL, 0);
+    }
+
+    class futex
+    {
+    public:
+        explicit futex(int value = 0):
+            d_value(value)
+        {}
+
+        boost::atomic<int> &value(void)
+        {
+            return d_value;
+        }
+
+        //! Sleep while the value equals \p expected; returns false on timeout
+        bool wait(int expected, double timeout = -1)
+        {
+            return futex_wait(reinterpret_cast<int *>(&d_value), expected, timeout);
+        }
+
+        //! Wake up to \p count waiters
+        void wake(int count = INT_MAX)
+        {
+            futex_wake(reinterpret_cast<int *>(&d_value), count);
+        }
+
+    private:
+        boost::atomic<int> d_value;
+    };
+
+#else
+
+    class futex
+    {
+    public:
+        explicit futex(int value = 0):
+            d_value(value)
+        {}
+
+        boost::atomic<int> &value(void)
+        {
+            return d_value;
+        }
+
+        bool wait(int expected, double timeout = -1)
+        {
+            boost::mutex::scoped_lock lock(d_mutex);
+            if (d_value.load() != expected) return true;
+            if (timeout < 0)
+            {
+                d_cond.wait(lock);
+                return true;
+            }
+            return d_cond.wait_for(lock, boost::chrono::nanoseconds((long long)(timeout*1e9))) == boost::cv_status::no_timeout;
+        }
+
+        void wake(int count = INT_MAX)
+        {
+            boost::mutex::scoped_lock lock(d_mutex);
+            if (count == 1) d_cond.notify_one();
+            else d_cond.notify_all();
+        }
+
+    private:
+        boost::atomic<int> d_value;
+        boost::mutex d_mutex;
+        boost::condition_variable d_cond;
+    };
+
+#endif
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_FUTEX_H
@@ -0,0 +1,115 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_HISTOGRAM_H
+#define INCLUDED_GRUEL_HISTOGRAM_H
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace gruel
+{
+
+    /*!
+     * \brief Lock-free histogram with power-of-two buckets.
+     *
+     * Bucket 0 counts the value 0 and bucket k counts values in
+     * [2^(k-1), 2^k).  Recording a value is one relaxed atomic add,
+     * cheap enough to leave enabled on hot paths.  Typically used for
+     * durations in nanoseconds.
+     */
+    class log2_histogram : boost::noncopyable
+    {
+    public:
+        enum {NUM_BUCKETS = 65};
+
+        log2_histogram(void)
+        {
+            reset();
+        }
+
+        //! Count one occurrence of \p value
+        void add(boost::uint64_t value)
+        {
+            d_buckets[bucket(value)].fetch_add(1, boost::memory_order_relaxed);
+        }
+
+        //! Zero all buckets
+        void reset(void)
+        {
+            for (size_t i = 0; i < NUM_BUCKETS; i++) d_buckets[i].store(0, boost::memory_order_relaxed);
+        }
+
+        //! Return the bucket counts, trailing empty buckets removed
+        std::vector<boost::uint64_t> counts(void) const
+        {
+            std::vector<boost::uint64_t> out(NUM_BUCKETS);
+            for (size_t i = 0; i < NUM_BUCKETS; i++) out[i] = d_buckets[i].load(boost::memory_order_relaxed);
+            while (not out.empty() and out.back() == 0) out.pop_back();
+            return out;
+        }
+
+        //! Return the bucket index for \p value
+        static size_t bucket(boost::uint64_t value)
+        {
+            if (value == 0) return 0;
+            #if defined(__GNUC__)
+            return 64 - __builtin_clzll(value);
+            #else
+            size_t k = 0;
+            while (value) {k++; value >>= 1;}
+            return k;
+            #endif
+        }
+
+        //! Return the inclusive upper bound of bucket \p k
+        static boost::uint64_t bucket_max(size_t k)
+        {
+            if (k == 0) return 0;
+            if (k >= 64) return ~boost::uint64_t(0);
+            return (boost::uint64_t(1) << k) - 1;
+        }
+
+        /*!
+         * Estimate the \p q quantile (0..1) from bucket counts
+         * returned by counts(); returns the upper bound of the bucket.
+         */
+        static boost::uint64_t quantile(const std::vector<boost::uint64_t> &counts, double q)
+        {
+            boost::uint64_t total = 0;
+            for (size_t i = 0; i < counts.size(); i++) total += counts[i];
+            if (total == 0) return 0;
+            const double target = q*double(total);
+            boost::uint64_t seen = 0;
+            for (size_t i = 0; i < counts.size(); i++)
+            {
+                seen += counts[i];
+                if (double(seen) >= target and seen != 0) return bucket_max(i);
+            }
+            return bucket_max(counts.size() - 1);
+        }
+
+        //! Format bucket counts as a JSON array
+        static std::string to_json(const std::vector<boost::uint64_t> &counts)
+        {
+            std::ostringstream ss;
+            ss << "[";
+            for (size_t i = 0; i < counts.size(); i++)
+            {
+                if (i != 0) ss << ", ";
+                ss << counts[i];
+            }
+            ss << "]";
+            return ss.str();
+        }
+
+    private:
+        boost::atomic<boost::uint64_t> d_buckets[NUM_BUCKETS];
+    };
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_HISTOGRAM_H
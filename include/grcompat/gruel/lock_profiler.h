@@ -0,0 +1,301 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_LOCK_PROFILER_H
+#define INCLUDED_GRUEL_LOCK_PROFILER_H
+
+#include <gruel/futex.h>
+#include <gruel/histogram.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+/*!
+ * Lock contention profiling.
+ *
+ * profiled_mutex is a boost::mutex that records, per lock site, how
+ * often it was acquired, how often the acquire had to wait, and
+ * histograms of wait and hold times.  A lock site is a name: by
+ * default the name given to the mutex (so every instance of a class
+ * member shares one site), or the source location when the lock is
+ * taken with GRUEL_PROFILED_LOCK.  Mutexes constructed without a name
+ * all share the one "unnamed mutex" site; name the mutex, or lock it
+ * with GRUEL_PROFILED_LOCK, to tell such locks apart in the report.
+ *
+ * Building with GRUEL_LOCK_PROFILING defined turns gruel::mutex into
+ * a profiled_mutex (and gruel::condition_variable into
+ * boost::condition_variable_any to match), so existing code is
+ * profiled without changes.  The report is written to stderr at exit,
+ * or on demand with gruel::lock_profiler::instance().report().
+ */
+
+namespace gruel
+{
+
+    //! Counters for one lock site
+    class lock_site : boost::noncopyable
+    {
+    public:
+        explicit lock_site(const std::string &name):
+            d_name(name),
+            d_acquires(0),
+            d_contended(0),
+            d_wait_ns(0),
+            d_hold_ns(0)
+        {}
+
+        const std::string &name(void) const
+        {
+            return d_name;
+        }
+
+        void record_acquire(bool contended, boost::uint64_t wait_ns)
+        {
+            d_acquires.fetch_add(1, boost::memory_order_relaxed);
+            if (not contended) return;
+            d_contended.fetch_add(1, boost::memory_order_relaxed);
+            d_wait_ns.fetch_add(wait_ns, boost::memory_order_relaxed);
+            d_wait_hist.add(wait_ns);
+        }
+
+        void record_release(boost::uint64_t hold_ns)
+        {
+            d_hold_ns.fetch_add(hold_ns, boost::memory_order_relaxed);
+            d_hold_hist.add(hold_ns);
+        }
+
+        boost::uint64_t acquires(void) const {return d_acquires.load(boost::memory_order_relaxed);}
+        boost::uint64_t contended(void) const {return d_contended.load(boost::memory_order_relaxed);}
+        boost::uint64_t wait_ns(void) const {return d_wait_ns.load(boost::memory_order_relaxed);}
+        boost::uint64_t hold_ns(void) const {return d_hold_ns.load(boost::memory_order_relaxed);}
+
+        //! Wait-time histogram of the contended acquires (log2 nanoseconds)
+        std::vector<boost::uint64_t> wait_histogram(void) const {return d_wait_hist.counts();}
+
+        //! Hold-time histogram (log2 nanoseconds)
+        std::vector<boost::uint64_t> hold_histogram(void) const {return d_hold_hist.counts();}
+
+    private:
+        const std::string d_name;
+        boost::atomic<boost::uint64_t> d_acquires;
+        boost::atomic<boost::uint64_t> d_contended;
+        boost::atomic<boost::uint64_t> d_wait_ns;
+        boost::atomic<boost::uint64_t> d_hold_ns;
+        log2_histogram d_wait_hist;
+        log2_histogram d_hold_hist;
+    };
+
+    //! Process-wide registry of lock sites
+    class lock_profiler : boost::noncopyable
+    {
+    public:
+        static lock_profiler &instance(void)
+        {
+            static lock_profiler profiler;
+            return profiler;
+        }
+
+        //! Return the site called \p name, creating it on first use
+        lock_site &site(const std::string &name)
+        {
+            boost::mutex::scoped_lock lock(d_mutex);
+            boost::shared_ptr<lock_site> &s = d_sites[name];
+            if (not s) s.reset(new lock_site(name));
+            return *s;
+        }
+
+        //! Write the report to stderr when the process exits (default true)
+        void set_report_at_exit(bool enable)
+        {
+            d_report_at_exit = enable;
+        }
+
+        /*!
+         * Format a table of every site that was acquired, the sites
+         * with the most total wait time first.
+         */
+        std::string report(void) const
+        {
+            std::vector<const lock_site *> sites;
+            {
+                boost::mutex::scoped_lock lock(d_mutex);
+                for (site_map_t::const_iterator it = d_sites.begin(); it != d_sites.end(); ++it)
+                {
+                    if (it->second->acquires() != 0) sites.push_back(it->second.get());
+                }
+            }
+            std::sort(sites.begin(), sites.end(), &more_wait);
+            size_t width = 10;
+            for (size_t i = 0; i < sites.size(); i++) width = std::max(width, sites[i]->name().size() + 2);
+
+            std::ostringstream ss;
+            ss << std::left << std::setw(int(width)) << "lock site" << std::right
+               << std::setw(12) << "acquires" << std::setw(12) << "contended"
+               << std::setw(14) << "wait ms" << std::setw(14) << "wait p99 ns"
+               << std::setw(14) << "hold ms" << std::setw(14) << "hold p99 ns" << "\n";
+            for (size_t i = 0; i < sites.size(); i++)
+            {
+                const lock_site &s = *sites[i];
+                ss << std::left << std::setw(int(width)) << s.name() << std::right
+                   << std::setw(12) << s.acquires() << std::setw(12) << s.contended()
+                   << std::setw(14) << std::fixed << std::setprecision(3) << s.wait_ns()*1e-6
+                   << std::setw(14) << log2_histogram::quantile(s.wait_histogram(), 0.99)
+                   << std::setw(14) << s.hold_ns()*1e-6
+                   << std::setw(14) << log2_histogram::quantile(s.hold_histogram(), 0.99) << "\n";
+            }
+            return ss.str();
+        }
+
+    private:
+        typedef std::map<std::string, boost::shared_ptr<lock_site> > site_map_t;
+
+        lock_profiler(void):
+            d_report_at_exit(true)
+        {}
+
+        ~lock_profiler(void)
+        {
+            if (d_report_at_exit) std::cerr << report() << std::flush;
+        }
+
+        static bool more_wait(const lock_site *a, const lock_site *b)
+        {
+            return a->wait_ns() > b->wait_ns();
+        }
+
+        mutable boost::mutex d_mutex;
+        site_map_t d_sites;
+        bool d_report_at_exit;
+    };
+
+    /*!
+     * \brief boost::mutex that records acquire and hold statistics.
+     *
+     * Plain lock() attributes the acquire to the mutex's own site;
+     * lock(site) attributes it to another one (see GRUEL_PROFILED_LOCK).
+     */
+    class profiled_mutex : boost::noncopyable
+    {
+    public:
+        typedef boost::unique_lock<profiled_mutex> scoped_lock;
+
+        //! Unnamed mutexes share the "unnamed mutex" site
+        profiled_mutex(void):
+            d_site(&unnamed_site()),
+            d_holder(NULL),
+            d_acquired(0)
+        {}
+
+        //! Mutexes sharing a \p name share a lock site
+        explicit profiled_mutex(const std::string &name):
+            d_site(&lock_profiler::instance().site(name)),
+            d_holder(NULL),
+            d_acquired(0)
+        {}
+
+        void lock(void)
+        {
+            lock(*d_site);
+        }
+
+        void lock(lock_site &site)
+        {
+            bool contended = false;
+            boost::uint64_t wait = 0;
+            if (not d_mutex.try_lock())
+            {
+                contended = true;
+                const boost::uint64_t t0 = monotonic_ns();
+                d_mutex.lock();
+                wait = monotonic_ns() - t0;
+            }
+            site.record_acquire(contended, wait);
+            d_holder = &site;
+            d_acquired = monotonic_ns();
+        }
+
+        bool try_lock(void)
+        {
+            if (not d_mutex.try_lock()) return false;
+            d_site->record_acquire(false, 0);
+            d_holder = d_site;
+            d_acquired = monotonic_ns();
+            return true;
+        }
+
+        void unlock(void)
+        {
+            d_holder->record_release(monotonic_ns() - d_acquired);
+            d_mutex.unlock();
+        }
+
+        //! The site plain lock() records into
+        lock_site &site(void)
+        {
+            return *d_site;
+        }
+
+    private:
+        //looked up once, so constructing a mutex does not take the registry lock
+        static lock_site &unnamed_site(void)
+        {
+            static lock_site &site = lock_profiler::instance().site("unnamed mutex");
+            return site;
+        }
+
+        boost::mutex d_mutex;
+        lock_site *d_site;
+        lock_site *d_holder;
+        boost::uint64_t d_acquired;
+    };
+
+    //! Scoped lock on a profiled_mutex, attributed to \p site
+    class profiled_scoped_lock : boost::noncopyable
+    {
+    public:
+        profiled_scoped_lock(profiled_mutex &mutex, lock_site &site):
+            d_mutex(mutex)
+        {
+            d_mutex.lock(site);
+        }
+
+        ~profiled_scoped_lock(void)
+        {
+            d_mutex.unlock();
+        }
+
+    private:
+        profiled_mutex &d_mutex;
+    };
+
+} //namespace gruel
+
+#define GRUEL_LOCK_PROFILER_STR2(x) #x
+#define GRUEL_LOCK_PROFILER_STR(x) GRUEL_LOCK_PROFILER_STR2(x)
+
+#ifdef GRUEL_LOCK_PROFILING
+
+/*!
+ * Declare a scoped lock \p name on \p mutex whose acquires are
+ * recorded under this source location.  Without GRUEL_LOCK_PROFILING
+ * this is a plain gruel::scoped_lock.
+ */
+#define GRUEL_PROFILED_LOCK(name, mutex) \
+    static gruel::lock_site &name ## _site = gruel::lock_profiler::instance().site(__FILE__ ":" GRUEL_LOCK_PROFILER_STR(__LINE__)); \
+    gruel::profiled_scoped_lock name(mutex, name ## _site)
+
+#else
+
+#define GRUEL_PROFILED_LOCK(name, mutex) gruel::scoped_lock name(mutex)
+
+#endif //GRUEL_LOCK_PROFILING
+
+#endif //INCLUDED_GRUEL_LOCK_PROFILER_H
@@ -0,0 +1,281 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_LOCKS_H
+#define INCLUDED_GRUEL_LOCKS_H
+
+#include <gruel/futex.h>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+
+/*!
+ * Lock types for short critical sections, to use alongside gruel::mutex.
+ *
+ * All of them provide lock(), try_lock() and unlock(), so they work
+ * with boost::unique_lock and boost::lock_guard; each class also
+ * names its RAII guard scoped_lock, like gruel::mutex does:
+ *
+ *   gruel::spinlock::scoped_lock lock(d_lock);
+ *
+ * spinlock and ticket_lock never sleep: use them only when the lock
+ * is held for a handful of instructions.  After a short spin they
+ * yield the CPU between polls, so a preempted holder can still make
+ * progress on an oversubscribed machine.  adaptive_mutex and rw_lock
+ * spin briefly, then sleep on a futex.
+ */
+
+namespace gruel
+{
+
+    //! Busy-wait backoff: pause hints at first, then yield the CPU
+    class spin_backoff
+    {
+    public:
+        spin_backoff(void):
+            d_count(0)
+        {}
+
+        void operator()(void)
+        {
+            if (d_count < 64)
+            {
+                d_count++;
+                cpu_relax();
+            }
+            else boost::this_thread::yield();
+        }
+
+    private:
+        unsigned d_count;
+    };
+
+    //! Test-and-test-and-set spinlock
+    class spinlock : boost::noncopyable
+    {
+    public:
+        typedef boost::unique_lock<spinlock> scoped_lock;
+
+        spinlock(void):
+            d_locked(false)
+        {}
+
+        void lock(void)
+        {
+            spin_backoff backoff;
+            while (d_locked.exchange(true, boost::memory_order_acquire))
+            {
+                while (d_locked.load(boost::memory_order_relaxed)) backoff();
+            }
+        }
+
+        bool try_lock(void)
+        {
+            return not d_locked.load(boost::memory_order_relaxed) and
+                not d_locked.exchange(true, boost::memory_order_acquire);
+        }
+
+        void unlock(void)
+        {
+            d_locked.store(false, boost::memory_order_release);
+        }
+
+    private:
+        boost::atomic<bool> d_locked;
+    };
+
+    //! FIFO spinlock: threads acquire the lock in the order they asked for it
+    class ticket_lock : boost::noncopyable
+    {
+    public:
+        typedef boost::unique_lock<ticket_lock> scoped_lock;
+
+        ticket_lock(void):
+            d_next(0),
+            d_serving(0)
+        {}
+
+        void lock(void)
+        {
+            const unsigned ticket = d_next.fetch_add(1, boost::memory_order_relaxed);
+            spin_backoff backoff;
+            while (d_serving.load(boost::memory_order_acquire) != ticket) backoff();
+        }
+
+        bool try_lock(void)
+        {
+            unsigned ticket = d_serving.load(boost::memory_order_relaxed);
+            return d_next.compare_exchange_strong(ticket, ticket + 1, boost::memory_order_acquire, boost::memory_order_relaxed);
+        }
+
+        void unlock(void)
+        {
+            d_serving.store(d_serving.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+        }
+
+    private:
+        boost::atomic<unsigned> d_next;
+        boost::atomic<unsigned> d_serving;
+    };
+
+    /*!
+     * \brief Mutex that spins for a while before sleeping on a futex.
+     *
+     * Uncontended lock and unlock are a single atomic operation each,
+     * and unlock only makes a syscall when a thread is asleep.
+     */
+    class adaptive_mutex : boost::noncopyable
+    {
+    public:
+        typedef boost::unique_lock<adaptive_mutex> scoped_lock;
+
+        //! \p spin is the number of polls before sleeping
+        explicit adaptive_mutex(unsigned spin = 100):
+            d_spin(spin)
+        {}
+
+        void lock(void)
+        {
+            //0 = unlocked, 1 = locked, 2 = locked with possible sleepers
+            int c = 0;
+            if (d_state.value().compare_exchange_strong(c, 1, boost::memory_order_acquire)) return;
+            for (unsigned i = 0; i < d_spin; i++)
+            {
+                cpu_relax();
+                c = 0;
+                if (d_state.value().load(boost::memory_order_relaxed) == 0 and
+                    d_state.value().compare_exchange_weak(c, 1, boost::memory_order_acquire)) return;
+            }
+            while (d_state.value().exchange(2, boost::memory_order_acquire) != 0)
+            {
+                d_state.wait(2);
+            }
+        }
+
+        bool try_lock(void)
+        {
+            int c = 0;
+            return d_state.value().compare_exchange_strong(c, 1, boost::memory_order_acquire);
+        }
+
+        void unlock(void)
+        {
+            if (d_state.value().exchange(0, boost::memory_order_release) == 2) d_state.wake(1);
+        }
+
+    private:
+        const unsigned d_spin;
+        futex d_state;
+    };
+
+    /*!
+     * \brief Reader-writer lock on a futex.
+     *
+     * Any number of readers or one writer hold the lock at a time.
+     * By default readers may join a held read lock even while a writer
+     * waits, which maximizes read throughput but can starve writers.
+     * With prefer_writers set, a waiting writer blocks new readers.
+     *
+     * lock()/unlock() take the write lock and lock_shared()/unlock_shared()
+     * the read lock, so boost::shared_lock works as the read guard.
+     */
+    class rw_lock : boost::noncopyable
+    {
+    public:
+        typedef boost::unique_lock<rw_lock> scoped_lock;
+        typedef boost::shared_lock<rw_lock> scoped_read_lock;
+
+        explicit rw_lock(bool prefer_writers = false, unsigned spin = 100):
+            d_prefer_writers(prefer_writers),
+            d_spin(spin),
+            d_state(0),
+            d_writers_waiting(0),
+            d_sleepers(0)
+        {}
+
+        void lock(void)
+        {
+            if (try_lock()) return;
+            d_writers_waiting.fetch_add(1);
+            wait_until(&rw_lock::try_lock);
+            d_writers_waiting.fetch_sub(1);
+        }
+
+        bool try_lock(void)
+        {
+            int s = 0;
+            return d_state.compare_exchange_strong(s, WRITER, boost::memory_order_acquire);
+        }
+
+        void unlock(void)
+        {
+            d_state.fetch_sub(WRITER, boost::memory_order_release);
+            notify();
+        }
+
+        void lock_shared(void)
+        {
+            if (try_lock_shared()) return;
+            wait_until(&rw_lock::try_lock_shared);
+        }
+
+        bool try_lock_shared(void)
+        {
+            int s = d_state.load(boost::memory_order_relaxed);
+            while (not (s & WRITER))
+            {
+                if (d_prefer_writers and d_writers_waiting.load(boost::memory_order_relaxed) != 0) return false;
+                if (d_state.compare_exchange_weak(s, s + 1, boost::memory_order_acquire)) return true;
+            }
+            return false;
+        }
+
+        void unlock_shared(void)
+        {
+            //only the last reader out can unblock anyone
+            if (d_state.fetch_sub(1, boost::memory_order_release) == 1) notify();
+        }
+
+    private:
+        enum {WRITER = 1 << 30};
+
+        void wait_until(bool (rw_lock::*acquire)(void))
+        {
+            for (unsigned i = 0; i < d_spin; i++)
+            {
+                cpu_relax();
+                if ((this->*acquire)()) return;
+            }
+            while (true)
+            {
+                //eventcount: read the key before re-checking, so a release in between is not lost
+                const int key = d_event.value().load();
+                d_sleepers.fetch_add(1);
+                if ((this->*acquire)())
+                {
+                    d_sleepers.fetch_sub(1);
+                    return;
+                }
+                d_event.wait(key);
+                d_sleepers.fetch_sub(1);
+                if ((this->*acquire)()) return;
+            }
+        }
+
+        void notify(void)
+        {
+            d_event.value().fetch_add(1);
+            if (d_sleepers.load() != 0) d_event.wake();
+        }
+
+        const bool d_prefer_writers;
+        const unsigned d_spin;
+        boost::atomic<int> d_state;
+        boost::atomic<int> d_writers_waiting;
+        boost::atomic<int> d_sleepers;
+        futex d_event;
+    };
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_LOCKS_H
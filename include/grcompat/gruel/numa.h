@@ -0,0 +1,363 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_NUMA_H
+#define INCLUDED_GRUEL_NUMA_H
+
+#include <gruel/thread.h>
+#include <boost/exception_ptr.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+/*!
+ * NUMA placement helpers.
+ *
+ * The topology is read from /sys/devices/system/node on Linux.  For
+ * testing, the GRUEL_NUMA_TOPOLOGY environment variable replaces it
+ * with a list of per-node CPU lists separated by semicolons, eg
+ * "0-3;4-7" for two nodes of four CPUs.
+ *
+ * Machines with a single node (or a non-Linux OS) report one node
+ * holding every CPU, and the placement calls quietly do nothing, so
+ * callers need no special case.  Memory placement is best effort:
+ * when the kernel refuses to bind pages to a node (eg a simulated
+ * topology) the memory is still returned, unbound.
+ */
+
+namespace gruel
+{
+
+    //! One NUMA node and the CPUs attached to it
+    struct numa_node
+    {
+        int id;
+        std::vector<size_t> cpus;
+    };
+
+namespace numa_detail {
+
+    //! Parse a kernel CPU or node list such as "0-3,8,10-11"
+    inline std::vector<size_t> parse_cpulist(const std::string &list)
+    {
+        std::vector<size_t> cpus;
+        std::istringstream ss(list);
+        std::string range;
+        while (std::getline(ss, range, ','))
+        {
+            if (range.empty()) continue;
+            const size_t dash = range.find('-');
+            const size_t first = std::strtoul(range.c_str(), NULL, 10);
+            const size_t last = (dash == std::string::npos)? first : std::strtoul(range.c_str() + dash + 1, NULL, 10);
+            for (size_t cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    inline std::vector<numa_node> load_topology(void)
+    {
+        std::vector<numa_node> nodes;
+
+        const char *sim = std::getenv("GRUEL_NUMA_TOPOLOGY");
+        if (sim != NULL)
+        {
+            std::istringstream ss(sim);
+            std::string list;
+            while (std::getline(ss, list, ';'))
+            {
+                numa_node node;
+                node.id = int(nodes.size());
+                node.cpus = parse_cpulist(list);
+                nodes.push_back(node);
+            }
+        }
+
+        #ifdef __linux__
+        std::ifstream online("/sys/devices/system/node/online");
+        std::string ids;
+        if (sim == NULL and online and std::getline(online, ids))
+        {
+            const std::vector<size_t> online_ids = parse_cpulist(ids);
+            for (size_t i = 0; i < online_ids.size(); i++)
+            {
+                std::ostringstream path;
+                path << "/sys/devices/system/node/node" << online_ids[i] << "/cpulist";
+                std::ifstream in(path.str().c_str());
+                std::string list;
+                numa_node node;
+                node.id = int(online_ids[i]);
+                if (in) std::getline(in, list);
+                node.cpus = parse_cpulist(list);
+                nodes.push_back(node);
+            }
+        }
+        #endif
+
+        if (nodes.empty())
+        {
+            numa_node node;
+            node.id = 0;
+            const size_t n = boost::thread::hardware_concurrency();
+            for (size_t cpu = 0; cpu < (n? n : 1); cpu++) node.cpus.push_back(cpu);
+            nodes.push_back(node);
+        }
+        return nodes;
+    }
+
+} //namespace numa_detail
+
+    //! Return the NUMA nodes, read once per process
+    inline const std::vector<numa_node> &numa_topology(void)
+    {
+        static const std::vector<numa_node> nodes = numa_detail::load_topology();
+        return nodes;
+    }
+
+    //! Return the number of NUMA nodes (at least 1)
+    inline size_t numa_num_nodes(void)
+    {
+        return numa_topology().size();
+    }
+
+    //! Return the node \p id, or NULL if there is no such node
+    inline const numa_node *numa_find_node(int id)
+    {
+        const std::vector<numa_node> &nodes = numa_topology();
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            if (nodes[i].id == id) return &nodes[i];
+        }
+        return NULL;
+    }
+
+    //! Return the node that \p cpu belongs to, or -1 if unknown
+    inline int numa_node_of_cpu(size_t cpu)
+    {
+        const std::vector<numa_node> &nodes = numa_topology();
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            for (size_t j = 0; j < nodes[i].cpus.size(); j++)
+            {
+                if (nodes[i].cpus[j] == cpu) return nodes[i].id;
+            }
+        }
+        return -1;
+    }
+
+    //! Return the node the calling thread is running on, or -1 if unknown
+    inline int numa_current_node(void)
+    {
+        #ifdef __linux__
+        const int cpu = sched_getcpu();
+        if (cpu >= 0) return numa_node_of_cpu(size_t(cpu));
+        #endif
+        return -1;
+    }
+
+    //! Format the topology, one line per node
+    inline std::string numa_topology_string(void)
+    {
+        std::ostringstream ss;
+        const std::vector<numa_node> &nodes = numa_topology();
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            ss << "node " << nodes[i].id << ": cpus";
+            for (size_t j = 0; j < nodes[i].cpus.size(); j++) ss << " " << nodes[i].cpus[j];
+            ss << "\n";
+        }
+        return ss.str();
+    }
+
+    //! Restrict the calling thread to the CPUs of \p node
+    inline bool numa_pin_thread(int node)
+    {
+        if (numa_num_nodes() == 1) return true;
+        const numa_node *n = numa_find_node(node);
+        return n != NULL and set_thread_affinity(n->cpus);
+    }
+
+    //! Restrict \p t to the CPUs of \p node
+    inline bool numa_pin_thread(thread &t, int node)
+    {
+        if (numa_num_nodes() == 1) return true;
+        const numa_node *n = numa_find_node(node);
+        return n != NULL and set_thread_affinity(t, n->cpus);
+    }
+
+    /*!
+     * Allocate \p size bytes of page-aligned memory placed on \p node.
+     * The pages are bound to the node when the kernel allows it.  When
+     * it does not (no mbind, or a sandbox refusing it) the pages are
+     * left untouched, so first-touch places each one on the node of the
+     * thread that first writes it: fill the buffer from a thread pinned
+     * with numa_pin_thread(node).  \p bound, if given, is set to whether
+     * the placement is guaranteed (always true on a single-node host).
+     * Throws std::bad_alloc on failure.  Release with numa_free().
+     */
+    inline void *numa_alloc(size_t size, int node, bool *bound = NULL)
+    {
+        if (size == 0) size = 1;
+        #ifdef __linux__
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        bool ok = numa_num_nodes() == 1;
+        #ifdef SYS_mbind
+        const size_t bits = 8*sizeof(unsigned long);
+        if (numa_num_nodes() > 1 and node >= 0 and size_t(node) < 64*bits)
+        {
+            unsigned long mask[64] = {0};
+            mask[node/bits] = 1UL << (node%bits);
+            const int mpol_bind = 2; //MPOL_BIND from numaif.h, which needs libnuma headers
+            ok = syscall(SYS_mbind, p, size, mpol_bind, mask, 64*bits + 1, 0) == 0;
+        }
+        #endif
+        if (bound != NULL) *bound = ok;
+        return p;
+        #else
+        (void)node;
+        void *p = std::malloc(size);
+        if (p == NULL) throw std::bad_alloc();
+        if (bound != NULL) *bound = numa_num_nodes() == 1;
+        return p;
+        #endif
+    }
+
+    //! Release memory from numa_alloc(); \p size must match the allocation
+    inline void numa_free(void *p, size_t size)
+    {
+        if (p == NULL) return;
+        #ifdef __linux__
+        munmap(p, size? size : 1);
+        #else
+        (void)size;
+        std::free(p);
+        #endif
+    }
+
+    /*!
+     * \brief STL allocator that places its memory on one NUMA node.
+     *
+     *   std::vector<float, gruel::numa_allocator<float> > buff(n, 0, gruel::numa_allocator<float>(1));
+     *
+     * Each allocation is at least a page, so use it for large buffers.
+     */
+    template <typename T>
+    class numa_allocator
+    {
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef const T *const_pointer;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef numa_allocator<U> other;
+        };
+
+        explicit numa_allocator(int node = 0): d_node(node){}
+
+        template <typename U>
+        numa_allocator(const numa_allocator<U> &other): d_node(other.node()){}
+
+        int node(void) const {return d_node;}
+
+        pointer allocate(size_type n, const void * = 0)
+        {
+            return static_cast<pointer>(numa_alloc(n*sizeof(T), d_node));
+        }
+
+        void deallocate(pointer p, size_type n)
+        {
+            numa_free(p, n*sizeof(T));
+        }
+
+        size_type max_size(void) const {return size_type(-1)/sizeof(T);}
+        pointer address(reference x) const {return &x;}
+        const_pointer address(const_reference x) const {return &x;}
+        void construct(pointer p, const T &val) {new (p) T(val);}
+        void destroy(pointer p) {p->~T();}
+
+    private:
+        int d_node;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const numa_allocator<T> &a, const numa_allocator<U> &b)
+    {
+        return a.node() == b.node();
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const numa_allocator<T> &a, const numa_allocator<U> &b)
+    {
+        return a.node() != b.node();
+    }
+
+namespace numa_detail {
+
+    template <typename Fn>
+    struct pinned_call
+    {
+        pinned_call(int node, Fn fn, boost::exception_ptr &error):
+            node(node), fn(fn), error(&error)
+        {}
+
+        void operator()(void)
+        {
+            try
+            {
+                numa_pin_thread(node);
+                fn();
+            }
+            catch (...)
+            {
+                *error = boost::current_exception();
+            }
+        }
+
+        int node;
+        Fn fn;
+        boost::exception_ptr *error;
+    };
+
+} //namespace numa_detail
+
+    /*!
+     * Run \p fn on a temporary thread pinned to \p node and wait for it.
+     * Memory that \p fn allocates and touches first lands on that node
+     * under the kernel's default first-touch policy.  On a single-node
+     * machine \p fn simply runs on the calling thread.
+     */
+    template <typename Fn>
+    void numa_run_on_node(int node, Fn fn)
+    {
+        if (numa_num_nodes() == 1)
+        {
+            fn();
+            return;
+        }
+        boost::exception_ptr error;
+        thread t(numa_detail::pinned_call<Fn>(node, fn, error));
+        t.join();
+        if (error) boost::rethrow_exception(error);
+    }
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_NUMA_H
@@ -0,0 +1,316 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_PMT_ALGORITHM_H
+#define INCLUDED_GRUEL_PMT_ALGORITHM_H
+
+#include <gruel/pmt.h>
+#include <gruel/thread_pool.h>
+#include <algorithm>
+#include <vector>
+
+/*!
+ * Generic sequence operations on pmt lists, vectors and uniform vectors.
+ *
+ * Unlike pmt_map, which only takes a plain function pointer, these
+ * accept any callable (function pointer, functor or lambda) so the
+ * procedure can be inlined into the loop.  Functions ending in _x
+ * modify their argument in place, like pmt_reverse_x.
+ */
+
+namespace pmt {
+
+/*
+ * ------------------------------------------------------------------------
+ *			  Parallel execution
+ * ------------------------------------------------------------------------
+ */
+
+/*!
+ * \brief Controls optional parallel execution of the vector operations.
+ *
+ * Vectors with fewer than \p threshold elements are always processed
+ * on the calling thread.  Larger vectors are split into contiguous
+ * chunks across \p num_threads threads (0 means hardware concurrency).
+ * The procedure must be safe to call concurrently on distinct elements.
+ */
+struct pmt_parallel_policy
+{
+    pmt_parallel_policy(size_t threshold = 0, size_t num_threads = 0):
+        threshold(threshold), num_threads(num_threads)
+    {}
+
+    size_t threshold;
+    size_t num_threads;
+};
+
+//! Run everything on the calling thread
+static const pmt_parallel_policy PMT_SEQUENTIAL(size_t(-1), 1);
+
+//! Split vectors of 4096 elements or more across all cores
+static const pmt_parallel_policy PMT_PARALLEL(4096, 0);
+
+namespace pmt_detail {
+
+    /*!
+     * Call body(begin, end) over [0, n), splitting the range into one
+     * chunk per thread on the shared gruel::thread_pool when the
+     * policy allows it.  The calling thread runs chunks too.  The
+     * first exception raised by any chunk is rethrown.
+     */
+    template <typename Body>
+    void parallel_chunks(size_t n, const pmt_parallel_policy &policy, Body body)
+    {
+        gruel::thread_pool &pool = gruel::thread_pool::global();
+        size_t nthreads = policy.num_threads;
+        if (nthreads == 0) nthreads = pool.size() + 1;
+        nthreads = std::min(nthreads, n);
+
+        if (n < policy.threshold or nthreads <= 1)
+        {
+            body(0, n);
+            return;
+        }
+
+        pool.parallel_for(0, n, body, (n + nthreads - 1)/nthreads);
+    }
+
+    template <typename Fn>
+    struct vector_map_body
+    {
+        vector_map_body(Fn proc, const pmt_t &in, const pmt_t &out):
+            proc(proc), in(in), out(out)
+        {}
+        void operator()(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                pmt::vector_set(out, i, proc(pmt::vector_ref(in, i)));
+            }
+        }
+        Fn proc;
+        pmt_t in, out;
+    };
+
+    template <typename T, typename Fn>
+    struct elements_map_body
+    {
+        elements_map_body(Fn proc, T *elems):
+            proc(proc), elems(elems)
+        {}
+        void operator()(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                elems[i] = proc(elems[i]);
+            }
+        }
+        Fn proc;
+        T *elems;
+    };
+
+} /* namespace pmt_detail */
+
+/*
+ * ------------------------------------------------------------------------
+ *		     Uniform vector element traits
+ * ------------------------------------------------------------------------
+ */
+
+/*!
+ * \brief Maps a C++ element type to its uniform vector functions.
+ *
+ * Specialized for the twelve uniform numeric vector element types.
+ * elements() and writable_elements() raise wrong_type when \p v is
+ * not a uniform vector of that element type.
+ */
+template <typename T>
+struct pmt_uniform_vector_traits;
+
+#define decl_pmt_uniform_vector_traits(type, suffix) \
+template <> \
+struct pmt_uniform_vector_traits<type > \
+{ \
+    static bool is(const pmt_t &v) { return pmt::is_ ## suffix ## vector(v); } \
+    static pmt_t init(size_t k, const type *data) { return pmt::init_ ## suffix ## vector(k, data); } \
+    static const type *elements(const pmt_t &v, size_t &len) { return pmt::suffix ## vector_elements(v, len); } \
+    static type *writable_elements(const pmt_t &v, size_t &len) { return pmt::suffix ## vector_writable_elements(v, len); } \
+}
+
+decl_pmt_uniform_vector_traits(uint8_t, u8);
+decl_pmt_uniform_vector_traits(int8_t, s8);
+decl_pmt_uniform_vector_traits(uint16_t, u16);
+decl_pmt_uniform_vector_traits(int16_t, s16);
+decl_pmt_uniform_vector_traits(uint32_t, u32);
+decl_pmt_uniform_vector_traits(int32_t, s32);
+decl_pmt_uniform_vector_traits(uint64_t, u64);
+decl_pmt_uniform_vector_traits(int64_t, s64);
+decl_pmt_uniform_vector_traits(float, f32);
+decl_pmt_uniform_vector_traits(double, f64);
+decl_pmt_uniform_vector_traits(std::complex<float>, c32);
+decl_pmt_uniform_vector_traits(std::complex<double>, c64);
+
+#undef decl_pmt_uniform_vector_traits
+
+/*
+ * ------------------------------------------------------------------------
+ *			 Lists and vectors
+ * ------------------------------------------------------------------------
+ */
+
+/*!
+ * \brief Apply \p proc to every element of \p seq and return the results.
+ *
+ * \p seq must be a list or a vector; the result has the same kind.
+ * \p proc is any callable taking a pmt_t and returning a pmt_t.
+ * Vectors above the policy threshold are processed in parallel.
+ */
+template <typename Fn>
+pmt_t pmt_map(Fn proc, const pmt_t &seq, const pmt_parallel_policy &policy = PMT_SEQUENTIAL)
+{
+    if (pmt::is_vector(seq))
+    {
+        const size_t n = pmt::length(seq);
+        pmt_t out = pmt::make_vector(n, PMT_NIL);
+        pmt_detail::parallel_chunks(n, policy, pmt_detail::vector_map_body<Fn>(proc, seq, out));
+        return out;
+    }
+
+    pmt_t result = PMT_NIL;
+    for (pmt_t p = seq; not pmt::is_null(p); p = pmt::cdr(p))
+    {
+        result = pmt::cons(proc(pmt::car(p)), result);
+    }
+    return pmt::reverse_x(result);
+}
+
+/*!
+ * \brief Replace every element of vector \p vec with \p proc applied to it.
+ *
+ * Vectors above the policy threshold are processed in parallel.
+ * \p vec must be a vector, otherwise wrong_type is raised.
+ */
+template <typename Fn>
+void pmt_map_x(Fn proc, const pmt_t &vec, const pmt_parallel_policy &policy = PMT_SEQUENTIAL)
+{
+    if (not pmt::is_vector(vec)) throw pmt::wrong_type("pmt_map_x", vec);
+    pmt_detail::parallel_chunks(pmt::length(vec), policy, pmt_detail::vector_map_body<Fn>(proc, vec, vec));
+}
+
+/*!
+ * \brief Return the elements of \p seq for which \p pred is true, in order.
+ *
+ * \p seq must be a list or a vector; the result has the same kind.
+ */
+template <typename Pred>
+pmt_t pmt_filter(Pred pred, const pmt_t &seq)
+{
+    if (pmt::is_vector(seq))
+    {
+        std::vector<pmt_t> keep;
+        const size_t n = pmt::length(seq);
+        for (size_t i = 0; i < n; i++)
+        {
+            pmt_t elem = pmt::vector_ref(seq, i);
+            if (pred(elem)) keep.push_back(elem);
+        }
+        pmt_t out = pmt::make_vector(keep.size(), PMT_NIL);
+        for (size_t i = 0; i < keep.size(); i++) pmt::vector_set(out, i, keep[i]);
+        return out;
+    }
+
+    pmt_t result = PMT_NIL;
+    for (pmt_t p = seq; not pmt::is_null(p); p = pmt::cdr(p))
+    {
+        pmt_t elem = pmt::car(p);
+        if (pred(elem)) result = pmt::cons(elem, result);
+    }
+    return pmt::reverse_x(result);
+}
+
+/*!
+ * \brief Left fold: acc = proc(acc, elem) over the elements of \p seq.
+ *
+ * \p seq must be a list or a vector.  Returns the final accumulator.
+ */
+template <typename Acc, typename Fn>
+Acc pmt_fold(Fn proc, Acc init, const pmt_t &seq)
+{
+    if (pmt::is_vector(seq))
+    {
+        const size_t n = pmt::length(seq);
+        for (size_t i = 0; i < n; i++) init = proc(init, pmt::vector_ref(seq, i));
+        return init;
+    }
+
+    for (pmt_t p = seq; not pmt::is_null(p); p = pmt::cdr(p))
+    {
+        init = proc(init, pmt::car(p));
+    }
+    return init;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ *			  Uniform vectors
+ *
+ * The element type T selects the uniform vector kind, for example
+ * pmt_uniform_vector_map_x<float>(scale, v) operates on an f32vector.
+ * ------------------------------------------------------------------------
+ */
+
+/*!
+ * \brief Apply \p proc to every element of \p v and return a new uniform vector.
+ */
+template <typename T, typename Fn>
+pmt_t pmt_uniform_vector_map(Fn proc, const pmt_t &v, const pmt_parallel_policy &policy = PMT_SEQUENTIAL)
+{
+    size_t len = 0;
+    const T *in = pmt_uniform_vector_traits<T>::elements(v, len);
+    pmt_t out = pmt_uniform_vector_traits<T>::init(len, in);
+    T *elems = pmt_uniform_vector_traits<T>::writable_elements(out, len);
+    pmt_detail::parallel_chunks(len, policy, pmt_detail::elements_map_body<T, Fn>(proc, elems));
+    return out;
+}
+
+/*!
+ * \brief Replace every element of \p v with \p proc applied to it, in place.
+ */
+template <typename T, typename Fn>
+void pmt_uniform_vector_map_x(Fn proc, const pmt_t &v, const pmt_parallel_policy &policy = PMT_SEQUENTIAL)
+{
+    size_t len = 0;
+    T *elems = pmt_uniform_vector_traits<T>::writable_elements(v, len);
+    pmt_detail::parallel_chunks(len, policy, pmt_detail::elements_map_body<T, Fn>(proc, elems));
+}
+
+/*!
+ * \brief Return a new uniform vector holding the elements of \p v for which \p pred is true.
+ */
+template <typename T, typename Pred>
+pmt_t pmt_uniform_vector_filter(Pred pred, const pmt_t &v)
+{
+    size_t len = 0;
+    const T *in = pmt_uniform_vector_traits<T>::elements(v, len);
+    std::vector<T> keep;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (pred(in[i])) keep.push_back(in[i]);
+    }
+    return pmt_uniform_vector_traits<T>::init(keep.size(), keep.empty()? NULL : &keep[0]);
+}
+
+/*!
+ * \brief Left fold: acc = proc(acc, elem) over the elements of \p v.
+ */
+template <typename T, typename Acc, typename Fn>
+Acc pmt_uniform_vector_fold(Fn proc, Acc init, const pmt_t &v)
+{
+    size_t len = 0;
+    const T *in = pmt_uniform_vector_traits<T>::elements(v, len);
+    for (size_t i = 0; i < len; i++) init = proc(init, in[i]);
+    return init;
+}
+
+} /* namespace pmt */
+
+#endif /* INCLUDED_GRUEL_PMT_ALGORITHM_H */
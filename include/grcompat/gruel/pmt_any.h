@@ -0,0 +1,196 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_PMT_ANY_H
+#define INCLUDED_GRUEL_PMT_ANY_H
+
+#include <gruel/pmt.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/type_traits/is_pod.hpp>
+
+/*!
+ * Typed storage for pmt any objects.
+ *
+ * pmt::any_ref returns the wrapped boost::any by value, so every read
+ * clones what the any holds.  How pmt_make_any_value stores a value
+ * depends on its size:
+ *
+ * - POD values up to PMT_ANY_SMALL_SIZE bytes (handles, pointers, small
+ *   structs) are stored as a plain T, exactly as pmt_make_any would:
+ *   one allocation to store, a small copy per read, and the handle
+ *   keeps its own copy.
+ * - Anything else is kept in a pmt_any_box, which holds the payload
+ *   behind a shared pointer: the clone made by any_ref is then a
+ *   reference count increment, never a copy of the payload, and the
+ *   handle shares the stored payload.
+ *
+ * boost::any always allocates its holder, so there is no storage
+ * without a heap allocation; the point is that reads of a large value
+ * never copy it.
+ */
+
+#ifndef PMT_ANY_SMALL_SIZE
+#define PMT_ANY_SMALL_SIZE (4*sizeof(void *))
+#endif
+
+namespace pmt {
+
+//! True when T is stored as a plain T rather than in a pmt_any_box
+template <typename T>
+struct pmt_any_is_small: boost::integral_constant<bool,
+    sizeof(T) <= PMT_ANY_SMALL_SIZE and boost::is_pod<T>::value>
+{};
+
+//! \brief Typed storage for a large value carried in a pmt any
+template <typename T>
+class pmt_any_box
+{
+public:
+    explicit pmt_any_box(const T &value):
+        d_value(boost::make_shared<const T>(value))
+    {}
+
+    const boost::shared_ptr<const T> &ptr(void) const
+    {
+        return d_value;
+    }
+
+private:
+    boost::shared_ptr<const T> d_value;
+};
+
+/*!
+ * \brief Read access to a value stored in a pmt any.
+ *
+ * For a large T the handle shares the payload with the any it came
+ * from, and keeps it alive for as long as the handle exists, even if
+ * the any is reset meanwhile.  For a small T it holds a copy.
+ */
+template <typename T, bool Small = pmt_any_is_small<T>::value>
+class pmt_any_handle
+{
+public:
+    explicit pmt_any_handle(const boost::shared_ptr<const T> &value):
+        d_value(value)
+    {}
+
+    const T &get(void) const
+    {
+        return *d_value;
+    }
+
+    const T &operator*(void) const
+    {
+        return *d_value;
+    }
+
+    const T *operator->(void) const
+    {
+        return d_value.get();
+    }
+
+private:
+    boost::shared_ptr<const T> d_value;
+};
+
+template <typename T>
+class pmt_any_handle<T, true>
+{
+public:
+    explicit pmt_any_handle(const T &value):
+        d_value(value)
+    {}
+
+    const T &get(void) const
+    {
+        return d_value;
+    }
+
+    const T &operator*(void) const
+    {
+        return d_value;
+    }
+
+    const T *operator->(void) const
+    {
+        return &d_value;
+    }
+
+private:
+    T d_value;
+};
+
+template <typename T>
+boost::any pmt_any_wrap(const T &value, boost::true_type)
+{
+    return boost::any(value);
+}
+
+template <typename T>
+boost::any pmt_any_wrap(const T &value, boost::false_type)
+{
+    return boost::any(pmt_any_box<T>(value));
+}
+
+//! Make an any holding \p value in typed storage
+template <typename T>
+pmt_t pmt_make_any_value(const T &value)
+{
+    return pmt::make_any(pmt_any_wrap(value, pmt_any_is_small<T>()));
+}
+
+//! Store \p value in typed storage in the any \p obj
+template <typename T>
+void pmt_any_set_value(const pmt_t &obj, const T &value)
+{
+    pmt::any_set(obj, pmt_any_wrap(value, pmt_any_is_small<T>()));
+}
+
+//! Return true if \p obj is an any holding a T, stored either way
+template <typename T>
+bool pmt_any_is(const pmt_t &obj)
+{
+    if (not pmt::is_any(obj)) return false;
+    const boost::any a = pmt::any_ref(obj);
+    return a.type() == typeid(pmt_any_box<T>) or a.type() == typeid(T);
+}
+
+template <typename T>
+pmt_any_handle<T> pmt_any_unwrap(const pmt_t &obj, const boost::any &a, boost::true_type)
+{
+    if (const T *value = boost::any_cast<T>(&a)) return pmt_any_handle<T>(*value);
+    throw pmt::wrong_type("pmt_any_value_ref", obj);
+}
+
+template <typename T>
+pmt_any_handle<T> pmt_any_unwrap(const pmt_t &obj, const boost::any &a, boost::false_type)
+{
+    if (const pmt_any_box<T> *box = boost::any_cast<pmt_any_box<T> >(&a))
+    {
+        return pmt_any_handle<T>(box->ptr());
+    }
+    if (const T *value = boost::any_cast<T>(&a))
+    {
+        return pmt_any_handle<T>(boost::make_shared<const T>(*value));
+    }
+    throw pmt::wrong_type("pmt_any_value_ref", obj);
+}
+
+/*!
+ * \brief Return a handle to the T held by the any \p obj.
+ *
+ * Works for values stored with pmt_make_any_value and for a plain T
+ * stored with pmt_make_any (a large one is then copied once).  Raises
+ * wrong_type if \p obj is not an any or does not hold a T.
+ */
+template <typename T>
+pmt_any_handle<T> pmt_any_value_ref(const pmt_t &obj)
+{
+    if (not pmt::is_any(obj)) throw pmt::wrong_type("pmt_any_value_ref", obj);
+    return pmt_any_unwrap<T>(obj, pmt::any_ref(obj), pmt_any_is_small<T>());
+}
+
+} /* namespace pmt */
+
+#endif /* INCLUDED_GRUEL_PMT_ANY_H */
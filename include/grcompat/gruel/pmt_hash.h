@@ -0,0 +1,266 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_PMT_HASH_H
+#define INCLUDED_GRUEL_PMT_HASH_H
+
+#include <gruel/pmt.h>
+#include <boost/functional/hash.hpp>
+#include <cstring>
+
+/*!
+ * Structural hashing and a faster structural equality for pmts.
+ *
+ * pmt_hash is consistent with pmt_equal: objects that are pmt_equal
+ * hash to the same value.  Hashes are only meaningful within one
+ * process (symbols hash by their interned identity).
+ *
+ * pmt_hashed pairs a pmt with its hash, computed once, so repeated
+ * comparisons (deduplication, lookups in unordered containers,
+ * matching reference vectors) can reject mismatches without walking
+ * the structure.  The cached hash goes stale if the object is mutated
+ * afterwards; only wrap objects that are no longer being modified.
+ */
+
+namespace pmt {
+
+namespace pmt_detail {
+
+    //! Return 1-12 for the uniform vector element kind of \p x, 0 if not a uniform vector
+    inline int uniform_vector_kind(const pmt_t &x)
+    {
+        if (pmt::is_blob(x)) return 1; //blobs are u8 vectors
+        if (not pmt::is_uniform_vector(x)) return 0;
+        if (pmt::is_u8vector(x)) return 1;
+        if (pmt::is_s8vector(x)) return 2;
+        if (pmt::is_u16vector(x)) return 3;
+        if (pmt::is_s16vector(x)) return 4;
+        if (pmt::is_u32vector(x)) return 5;
+        if (pmt::is_s32vector(x)) return 6;
+        if (pmt::is_u64vector(x)) return 7;
+        if (pmt::is_s64vector(x)) return 8;
+        if (pmt::is_f32vector(x)) return 9;
+        if (pmt::is_f64vector(x)) return 10;
+        if (pmt::is_c32vector(x)) return 11;
+        if (pmt::is_c64vector(x)) return 12;
+        return 0;
+    }
+
+    //! Hash a byte range 8 bytes at a time (multiply-xorshift mixing)
+    inline size_t hash_bytes(const void *buf, size_t len)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(buf);
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8)
+        {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            h = (h ^ w) * 0xff51afd7ed558ccdULL;
+            h ^= h >> 32;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, p + i, len - i);
+        h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 29;
+        return size_t(h);
+    }
+
+} /* namespace pmt_detail */
+
+/*!
+ * \brief Return a structural hash of \p x, consistent with pmt_equal.
+ *
+ * Lists are walked iteratively, so long lists do not recurse deeply.
+ * Objects without structure (any, msg_accepter) hash by identity.
+ */
+inline size_t pmt_hash(const pmt_t &x)
+{
+    size_t seed = 0;
+    pmt_t p = x;
+    while (pmt::is_pair(p))
+    {
+        boost::hash_combine(seed, 0x5a17);
+        boost::hash_combine(seed, pmt_hash(pmt::car(p)));
+        p = pmt::cdr(p);
+    }
+
+    if (not p or pmt::is_null(p))
+    {
+        boost::hash_combine(seed, 0);
+    }
+    else if (pmt::is_bool(p))
+    {
+        boost::hash_combine(seed, pmt::is_true(p)? 1 : 2);
+    }
+    else if (pmt::is_integer(p))
+    {
+        boost::hash_combine(seed, pmt::to_long(p));
+    }
+    else if (pmt::is_uint64(p))
+    {
+        boost::hash_combine(seed, pmt::to_uint64(p));
+    }
+    else if (pmt::is_real(p))
+    {
+        boost::hash_combine(seed, pmt::to_double(p));
+    }
+    else if (pmt::is_complex(p))
+    {
+        const std::complex<double> z = pmt::to_complex(p);
+        boost::hash_combine(seed, z.real());
+        boost::hash_combine(seed, z.imag());
+    }
+    else if (const int kind = pmt_detail::uniform_vector_kind(p))
+    {
+        size_t len = 0;
+        const void *elems = pmt::uniform_vector_elements(p, len);
+        boost::hash_combine(seed, kind);
+        boost::hash_combine(seed, pmt_detail::hash_bytes(elems, len));
+    }
+    else if (pmt::is_vector(p) or pmt::is_tuple(p))
+    {
+        const bool vec = pmt::is_vector(p);
+        const size_t n = pmt::length(p);
+        boost::hash_combine(seed, vec? 0x7ec : 0x7091e);
+        for (size_t i = 0; i < n; i++)
+        {
+            boost::hash_combine(seed, pmt_hash(vec? pmt::vector_ref(p, i) : pmt::tuple_ref(p, i)));
+        }
+    }
+    else
+    {
+        boost::hash_combine(seed, p.get());
+    }
+    return seed;
+}
+
+/*!
+ * \brief Structural equality with the same result as pmt_equal.
+ *
+ * The one difference is that uniform vectors of different element
+ * types are never equal, even when their bytes happen to match.
+ * Shared subobjects are accepted by identity without descending into
+ * them, mismatching kinds and lengths are rejected before any element
+ * is compared, and uniform vector and blob payloads are compared with
+ * a single memcmp (the C library picks a vectorized implementation).
+ */
+inline bool pmt_equal_fast(const pmt_t &x, const pmt_t &y)
+{
+    pmt_t a = x, b = y;
+    while (pmt::is_pair(a) and pmt::is_pair(b))
+    {
+        if (a == b) return true;
+        if (not pmt_equal_fast(pmt::car(a), pmt::car(b))) return false;
+        a = pmt::cdr(a);
+        b = pmt::cdr(b);
+    }
+
+    if (a == b) return true;
+    if (pmt::eqv(a, b)) return true;
+
+    const int kind = pmt_detail::uniform_vector_kind(a);
+    if (kind != 0)
+    {
+        if (kind != pmt_detail::uniform_vector_kind(b)) return false;
+        size_t len_a = 0, len_b = 0;
+        const void *elems_a = pmt::uniform_vector_elements(a, len_a);
+        const void *elems_b = pmt::uniform_vector_elements(b, len_b);
+        return len_a == len_b and (elems_a == elems_b or std::memcmp(elems_a, elems_b, len_a) == 0);
+    }
+
+    if ((pmt::is_vector(a) and pmt::is_vector(b)) or (pmt::is_tuple(a) and pmt::is_tuple(b)))
+    {
+        const bool vec = pmt::is_vector(a);
+        const size_t n = pmt::length(a);
+        if (n != pmt::length(b)) return false;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (vec)
+            {
+                if (not pmt_equal_fast(pmt::vector_ref(a, i), pmt::vector_ref(b, i))) return false;
+            }
+            else
+            {
+                if (not pmt_equal_fast(pmt::tuple_ref(a, i), pmt::tuple_ref(b, i))) return false;
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief A pmt together with its structural hash, computed once.
+ *
+ * Comparisons check the cached hashes first and only fall back to a
+ * structural comparison when they match.  Use pmt_hashed as the key
+ * type of boost::unordered_set/map (or std::unordered_*) to
+ * deduplicate metadata.
+ */
+class pmt_hashed
+{
+public:
+    pmt_hashed(void):
+        d_obj(PMT_NIL), d_hash(pmt_hash(PMT_NIL))
+    {}
+
+    pmt_hashed(const pmt_t &obj):
+        d_obj(obj), d_hash(pmt_hash(obj))
+    {}
+
+    //! Return the wrapped object
+    const pmt_t &get(void) const
+    {
+        return d_obj;
+    }
+
+    //! Return the cached hash
+    size_t hash(void) const
+    {
+        return d_hash;
+    }
+
+    bool operator==(const pmt_hashed &rhs) const
+    {
+        return d_hash == rhs.d_hash and pmt_equal_fast(d_obj, rhs.d_obj);
+    }
+
+    bool operator!=(const pmt_hashed &rhs) const
+    {
+        return not (*this == rhs);
+    }
+
+private:
+    pmt_t d_obj;
+    size_t d_hash;
+};
+
+//! boost::hash support for pmt_hashed
+inline size_t hash_value(const pmt_hashed &h)
+{
+    return h.hash();
+}
+
+//! Hash function object for unordered containers keyed by pmt_hashed
+struct pmt_hashed_hash
+{
+    size_t operator()(const pmt_hashed &h) const
+    {
+        return h.hash();
+    }
+};
+
+/*!
+ * \brief Hash-first equality on pre-hashed objects.
+ *
+ * Returns false immediately when the cached hashes differ.
+ */
+inline bool pmt_equal(const pmt_hashed &x, const pmt_hashed &y)
+{
+    return x == y;
+}
+
+} /* namespace pmt */
+
+#endif /* INCLUDED_GRUEL_PMT_HASH_H */
@@ -0,0 +1,134 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_SPSC_RING_H
+#define INCLUDED_GRUEL_SPSC_RING_H
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/type_traits/has_trivial_destructor.hpp>
+#include <cstddef>
+
+namespace gruel
+{
+
+    /*!
+     * \brief Lock-free ring for exactly one producer and one consumer thread.
+     *
+     * The capacity is a compile-time power of two, so wrapping an index
+     * is an AND with a constant.  The indices run freely and are only
+     * masked on access; head and tail sit on separate cache lines, and
+     * each side keeps a private copy of the other side's index, so the
+     * shared lines are only read when the ring looks full (producer) or
+     * empty (consumer).
+     *
+     * Nothing here blocks: push() and pop() return false (or the bulk
+     * versions a short count) when there is no room or nothing to read.
+     * Unless T has a trivial destructor, pop() resets the slot it read to
+     * T(), so a popped gr_message_sptr is released as soon as the
+     * consumer drops it, not when the ring wraps around.
+     */
+    template <typename T, size_t Capacity>
+    class spsc_ring : boost::noncopyable
+    {
+    public:
+        BOOST_STATIC_ASSERT(Capacity >= 2 and (Capacity & (Capacity - 1)) == 0);
+
+        spsc_ring(void):
+            d_buff(new T[Capacity]),
+            d_head(0),
+            d_tail_cache(0),
+            d_tail(0),
+            d_head_cache(0)
+        {}
+
+        static size_t capacity(void)
+        {
+            return Capacity;
+        }
+
+        //! Producer: append \p item; false when the ring is full
+        bool push(const T &item)
+        {
+            const size_t head = d_head.load(boost::memory_order_relaxed);
+            if (head - d_tail_cache == Capacity)
+            {
+                d_tail_cache = d_tail.load(boost::memory_order_acquire);
+                if (head - d_tail_cache == Capacity) return false;
+            }
+            d_buff[head & MASK] = item;
+            d_head.store(head + 1, boost::memory_order_release);
+            return true;
+        }
+
+        //! Producer: append up to \p n items; returns how many fit
+        size_t push(const T *items, size_t n)
+        {
+            const size_t head = d_head.load(boost::memory_order_relaxed);
+            if (Capacity - (head - d_tail_cache) < n) d_tail_cache = d_tail.load(boost::memory_order_acquire);
+            const size_t room = Capacity - (head - d_tail_cache);
+            if (n > room) n = room;
+            for (size_t i = 0; i < n; i++) d_buff[(head + i) & MASK] = items[i];
+            d_head.store(head + n, boost::memory_order_release);
+            return n;
+        }
+
+        //! Consumer: take the oldest item into \p item; false when empty
+        bool pop(T &item)
+        {
+            const size_t tail = d_tail.load(boost::memory_order_relaxed);
+            if (tail == d_head_cache)
+            {
+                d_head_cache = d_head.load(boost::memory_order_acquire);
+                if (tail == d_head_cache) return false;
+            }
+            item = d_buff[tail & MASK];
+            if (RESET) d_buff[tail & MASK] = T();
+            d_tail.store(tail + 1, boost::memory_order_release);
+            return true;
+        }
+
+        //! Consumer: take up to \p n items; returns how many were read
+        size_t pop(T *items, size_t n)
+        {
+            const size_t tail = d_tail.load(boost::memory_order_relaxed);
+            if (d_head_cache - tail < n) d_head_cache = d_head.load(boost::memory_order_acquire);
+            const size_t avail = d_head_cache - tail;
+            if (n > avail) n = avail;
+            for (size_t i = 0; i < n; i++) items[i] = d_buff[(tail + i) & MASK];
+            if (RESET) for (size_t i = 0; i < n; i++) d_buff[(tail + i) & MASK] = T();
+            d_tail.store(tail + n, boost::memory_order_release);
+            return n;
+        }
+
+        //! Number of items queued (exact only when called from one of the two threads)
+        size_t size(void) const
+        {
+            return d_head.load(boost::memory_order_acquire) - d_tail.load(boost::memory_order_acquire);
+        }
+
+        bool empty(void) const
+        {
+            return size() == 0;
+        }
+
+    private:
+        static const size_t MASK = Capacity - 1;
+        //release what a popped slot holds, unless that is a no-op
+        static const bool RESET = not boost::has_trivial_destructor<T>::value;
+
+        //pad so the producer and consumer lines never share a cache line
+        boost::scoped_array<T> d_buff;
+        char d_pad0[64];
+        boost::atomic<size_t> d_head; //!< written by the producer
+        size_t d_tail_cache; //!< producer's copy of d_tail
+        char d_pad1[64];
+        boost::atomic<size_t> d_tail; //!< written by the consumer
+        size_t d_head_cache; //!< consumer's copy of d_head
+        char d_pad2[64];
+    };
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_SPSC_RING_H
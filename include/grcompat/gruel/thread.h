@@ -4,13 +4,277 @@
 #define GRUEL_THREAD_H
 
 #include <boost/thread.hpp>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifdef GRUEL_LOCK_PROFILING
+#include <gruel/lock_profiler.h>
+#endif
 
 namespace gruel
 {
     typedef boost::thread thread;
+#ifdef GRUEL_LOCK_PROFILING
+    typedef profiled_mutex mutex;
+    typedef profiled_mutex::scoped_lock scoped_lock;
+    typedef boost::condition_variable_any condition_variable;
+#else
     typedef boost::mutex mutex;
     typedef boost::mutex::scoped_lock scoped_lock;
     typedef boost::condition_variable condition_variable;
+#endif
+
+    /***********************************************************************
+     * Thread attributes
+     *
+     * Each setter returns false when the call is refused (usually for
+     * lack of privileges, eg SCHED_FIFO without CAP_SYS_NICE) or is not
+     * supported on this platform.  Affinity, naming and memory locking
+     * are Linux only; scheduling works on any pthread platform.
+     **********************************************************************/
+
+    //! Scheduling policies for set_thread_scheduling()
+    enum thread_sched_t
+    {
+        THREAD_SCHED_OTHER, //!< the default time-sharing policy
+        THREAD_SCHED_FIFO, //!< real-time, runs until it blocks or yields
+        THREAD_SCHED_RR, //!< real-time, round-robin among equal priorities
+        THREAD_SCHED_BATCH, //!< time-sharing, treated as CPU bound
+        THREAD_SCHED_IDLE //!< runs only when nothing else wants the CPU
+    };
+
+#if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+    typedef pthread_t native_thread_t;
+
+    inline native_thread_t native_handle(thread &t)
+    {
+        return t.native_handle();
+    }
+
+    inline native_thread_t native_handle(void)
+    {
+        return pthread_self();
+    }
+
+namespace thread_detail {
+
+    inline bool set_affinity(native_thread_t t, const std::vector<size_t> &cpus)
+    {
+        #ifdef __linux__
+        if (cpus.empty()) return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (size_t i = 0; i < cpus.size(); i++)
+        {
+            if (cpus[i] >= CPU_SETSIZE) return false;
+            CPU_SET(cpus[i], &set);
+        }
+        return pthread_setaffinity_np(t, sizeof(set), &set) == 0;
+        #else
+        (void)t; (void)cpus;
+        return false;
+        #endif
+    }
+
+    inline bool set_scheduling(native_thread_t t, thread_sched_t policy, int priority)
+    {
+        int native;
+        switch (policy)
+        {
+        case THREAD_SCHED_FIFO: native = SCHED_FIFO; break;
+        case THREAD_SCHED_RR: native = SCHED_RR; break;
+        #ifdef __linux__
+        case THREAD_SCHED_BATCH: native = SCHED_BATCH; break;
+        case THREAD_SCHED_IDLE: native = SCHED_IDLE; break;
+        #endif
+        case THREAD_SCHED_OTHER: native = SCHED_OTHER; break;
+        default: return false;
+        }
+        struct sched_param param;
+        param.sched_priority = priority;
+        return pthread_setschedparam(t, native, &param) == 0;
+    }
+
+    inline bool set_name(native_thread_t t, const std::string &name)
+    {
+        #ifdef __linux__
+        return pthread_setname_np(t, name.substr(0, 15).c_str()) == 0;
+        #else
+        (void)t; (void)name;
+        return false;
+        #endif
+    }
+
+} //namespace thread_detail
+#endif
+
+    //! Restrict \p t to run on the CPUs listed in \p cpus
+    inline bool set_thread_affinity(thread &t, const std::vector<size_t> &cpus)
+    {
+        #if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+        return thread_detail::set_affinity(native_handle(t), cpus);
+        #else
+        (void)t; (void)cpus;
+        return false;
+        #endif
+    }
+
+    //! Restrict the calling thread to run on the CPUs listed in \p cpus
+    inline bool set_thread_affinity(const std::vector<size_t> &cpus)
+    {
+        #if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+        return thread_detail::set_affinity(native_handle(), cpus);
+        #else
+        (void)cpus;
+        return false;
+        #endif
+    }
+
+    //! Return the CPUs the calling thread may run on (empty if unknown)
+    inline std::vector<size_t> get_thread_affinity(void)
+    {
+        std::vector<size_t> cpus;
+        #ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) return cpus;
+        for (size_t i = 0; i < CPU_SETSIZE; i++)
+        {
+            if (CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+        #endif
+        return cpus;
+    }
+
+    //! Set the scheduling policy and priority of \p t
+    inline bool set_thread_scheduling(thread &t, thread_sched_t policy, int priority = 0)
+    {
+        #if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+        return thread_detail::set_scheduling(native_handle(t), policy, priority);
+        #else
+        (void)t; (void)policy; (void)priority;
+        return false;
+        #endif
+    }
+
+    //! Set the scheduling policy and priority of the calling thread
+    inline bool set_thread_scheduling(thread_sched_t policy, int priority = 0)
+    {
+        #if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+        return thread_detail::set_scheduling(native_handle(), policy, priority);
+        #else
+        (void)policy; (void)priority;
+        return false;
+        #endif
+    }
+
+    //! Name \p t for debuggers and top (truncated to 15 characters)
+    inline bool set_thread_name(thread &t, const std::string &name)
+    {
+        #if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+        return thread_detail::set_name(native_handle(t), name);
+        #else
+        (void)t; (void)name;
+        return false;
+        #endif
+    }
+
+    //! Name the calling thread for debuggers and top (truncated to 15 characters)
+    inline bool set_thread_name(const std::string &name)
+    {
+        #if defined(BOOST_THREAD_PLATFORM_PTHREAD)
+        return thread_detail::set_name(native_handle(), name);
+        #else
+        (void)name;
+        return false;
+        #endif
+    }
+
+    //! Lock the process's current and future pages into RAM (mlockall)
+    inline bool lock_memory(void)
+    {
+        #ifdef __linux__
+        return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        #else
+        return false;
+        #endif
+    }
+
+    /*!
+     * \brief Attributes a thread applies to itself when it starts.
+     *
+     * Empty or default fields are left alone.  Use with_attributes()
+     * to wrap a thread function so the attributes are in place before
+     * it runs:
+     *
+     *   gruel::thread_attributes attrs;
+     *   attrs.cpus.push_back(3);
+     *   attrs.policy = gruel::THREAD_SCHED_FIFO;
+     *   attrs.priority = 50;
+     *   attrs.name = "rx";
+     *   gruel::thread t(gruel::with_attributes(attrs, rx_loop));
+     */
+    struct thread_attributes
+    {
+        thread_attributes(void):
+            policy(THREAD_SCHED_OTHER), priority(0), lock_memory(false)
+        {}
+
+        std::vector<size_t> cpus; //!< CPUs to pin to; empty leaves the affinity alone
+        thread_sched_t policy; //!< scheduling policy; OTHER with priority 0 leaves it alone
+        int priority; //!< scheduling priority for policy
+        std::string name; //!< thread name; empty leaves the name alone
+        bool lock_memory; //!< call gruel::lock_memory() first
+
+        /*!
+         * Apply the attributes to the calling thread.
+         * Returns false if any of them was refused; the others are still applied.
+         */
+        bool apply(void) const
+        {
+            bool ok = true;
+            if (lock_memory) ok = gruel::lock_memory() and ok;
+            if (not cpus.empty()) ok = set_thread_affinity(cpus) and ok;
+            if (policy != THREAD_SCHED_OTHER or priority != 0) ok = set_thread_scheduling(policy, priority) and ok;
+            if (not name.empty()) ok = set_thread_name(name) and ok;
+            return ok;
+        }
+    };
+
+    //! Thread function that applies attributes, then runs the wrapped function
+    template <typename Fn>
+    struct attributed_thread_fn
+    {
+        attributed_thread_fn(const thread_attributes &attrs, Fn fn):
+            attrs(attrs), fn(fn)
+        {}
+
+        void operator()(void)
+        {
+            attrs.apply();
+            fn();
+        }
+
+        thread_attributes attrs;
+        Fn fn;
+    };
+
+    //! Wrap \p fn so that the thread running it first applies \p attrs
+    template <typename Fn>
+    attributed_thread_fn<Fn> with_attributes(const thread_attributes &attrs, Fn fn)
+    {
+        return attributed_thread_fn<Fn>(attrs, fn);
+    }
 }
 
 #endif //GRUEL_THREAD_H
@@ -0,0 +1,377 @@
+/* -*- c++ -*- */
+
+#ifndef INCLUDED_GRUEL_THREAD_POOL_H
+#define INCLUDED_GRUEL_THREAD_POOL_H
+
+#include <gruel/thread.h>
+#include <boost/thread/future.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/function.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/utility/result_of.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+namespace gruel
+{
+
+    /*!
+     * \brief Fixed-size work-stealing executor.
+     *
+     * Each worker owns a deque of tasks.  A worker runs its own tasks
+     * newest first and, when it runs dry, steals the oldest task from
+     * another worker.  Tasks submitted from a worker go to that
+     * worker's deque; tasks submitted from other threads are dealt
+     * round-robin across the workers.
+     *
+     * When max_queued is non-zero, submitting from outside the pool
+     * blocks while that many tasks are waiting.  A worker never
+     * blocks on a full pool; it runs the task inline instead, so
+     * nested submission cannot deadlock.
+     *
+     * The destructor runs the tasks still queued, then joins the
+     * workers.
+     */
+    class thread_pool : boost::noncopyable
+    {
+    public:
+        typedef boost::function<void(void)> task_type;
+
+        /*!
+         * Start \p num_threads workers (0 means one per hardware thread).
+         * \p max_queued bounds the tasks waiting to run (0 means unbounded).
+         */
+        explicit thread_pool(size_t num_threads = 0, size_t max_queued = 0):
+            d_max_queued(max_queued),
+            d_pending(0),
+            d_idle(0),
+            d_blocked(0),
+            d_next(0),
+            d_stop(false)
+        {
+            if (num_threads == 0) num_threads = boost::thread::hardware_concurrency();
+            if (num_threads == 0) num_threads = 1;
+            d_workers.resize(num_threads);
+            for (size_t i = 0; i < num_threads; i++)
+            {
+                d_workers[i] = boost::make_shared<worker_t>();
+            }
+            for (size_t i = 0; i < num_threads; i++)
+            {
+                d_workers[i]->id = d_threads.create_thread(boost::bind(&thread_pool::run, this, i))->get_id();
+            }
+        }
+
+        ~thread_pool(void)
+        {
+            {
+                gruel::scoped_lock lock(d_mutex);
+                d_stop = true;
+            }
+            d_work_cond.notify_all();
+            d_space_cond.notify_all();
+            d_threads.join_all();
+        }
+
+        //! Return the number of workers
+        size_t size(void) const
+        {
+            return d_workers.size();
+        }
+
+        //! Return the number of tasks waiting to run
+        size_t pending(void) const
+        {
+            return d_pending.load(boost::memory_order_relaxed);
+        }
+
+        /*!
+         * Queue \p task without a future.
+         * Exceptions escaping \p task are discarded; use submit() to observe them.
+         */
+        void post(const task_type &task)
+        {
+            const int self = current_worker();
+            if (self < 0 and d_max_queued != 0) wait_for_space();
+            else if (self >= 0 and d_max_queued != 0 and pending() >= d_max_queued)
+            {
+                run_task(task);
+                return;
+            }
+            push(self < 0? next_worker() : size_t(self), task);
+        }
+
+        /*!
+         * Queue \p fn and return a future for its result; an exception
+         * thrown by \p fn is rethrown by the future's get().
+         * Under C++03, \p fn must declare its result type the way
+         * boost::result_of expects (function pointers and boost::bind
+         * expressions do).
+         */
+        template <typename Fn>
+        boost::shared_future<typename boost::result_of<Fn(void)>::type> submit(Fn fn)
+        {
+            typedef typename boost::result_of<Fn(void)>::type result_type;
+            typedef typename packaged_task_of<result_type>::type packaged_type;
+            boost::shared_ptr<packaged_type> task = boost::make_shared<packaged_type>(fn);
+            boost::shared_future<result_type> future(task->get_future());
+            post(run_packaged<packaged_type>(task));
+            return future;
+        }
+
+        /*!
+         * Wait until \p future is ready.  Called from a worker, this
+         * runs queued tasks while waiting, so a task may wait on the
+         * futures of tasks it submitted without starving the pool.
+         */
+        template <typename Future>
+        void wait(const Future &future)
+        {
+            const int self = current_worker();
+            while (not future.is_ready())
+            {
+                task_type task;
+                if (self >= 0 and pop(size_t(self), task)) run_task(task);
+                else if (self >= 0) boost::this_thread::yield();
+                else future.wait();
+            }
+        }
+
+        /*!
+         * Call \p body(chunk_begin, chunk_end) over [begin, end) split
+         * into chunks of \p grain indexes (0 picks about four chunks per
+         * worker).  The calling thread works on chunks too, and the call
+         * returns when every chunk has run.  The first exception thrown
+         * by \p body is rethrown here.
+         */
+        template <typename Body>
+        void parallel_for(size_t begin, size_t end, Body body, size_t grain = 0)
+        {
+            if (end <= begin) return;
+            const size_t n = end - begin;
+            if (grain == 0) grain = std::max<size_t>(1, n/(4*size()));
+            const size_t chunks = (n + grain - 1)/grain;
+            if (chunks == 1)
+            {
+                body(begin, end);
+                return;
+            }
+
+            boost::shared_ptr<for_state<Body> > state = boost::make_shared<for_state<Body> >(body, begin, end, grain, chunks);
+            const size_t helpers = std::min(chunks - 1, size());
+            const int self = current_worker();
+            for (size_t i = 0; i < helpers; i++)
+            {
+                //helpers are optional: skip them rather than wait on a full pool
+                if (d_max_queued != 0 and pending() >= d_max_queued) break;
+                push(self < 0? next_worker() : size_t(self), boost::bind(&for_state<Body>::work, state));
+            }
+            state->work();
+            state->wait();
+        }
+
+        //! Return a process-wide pool with one worker per hardware thread
+        static thread_pool &global(void)
+        {
+            static thread_pool pool;
+            return pool;
+        }
+
+    private:
+        struct worker_t
+        {
+            gruel::mutex mutex;
+            std::deque<task_type> tasks;
+            boost::thread::id id;
+        };
+
+        template <typename R>
+        struct packaged_task_of
+        {
+            #ifdef BOOST_THREAD_PROVIDES_SIGNATURE_PACKAGED_TASK
+            typedef boost::packaged_task<R(void)> type;
+            #else
+            typedef boost::packaged_task<R> type;
+            #endif
+        };
+
+        template <typename Task>
+        struct run_packaged
+        {
+            run_packaged(const boost::shared_ptr<Task> &task): task(task){}
+            void operator()(void){(*task)();}
+            boost::shared_ptr<Task> task;
+        };
+
+        //! Shared by the caller and helpers of one parallel_for
+        template <typename Body>
+        struct for_state : boost::noncopyable
+        {
+            for_state(Body body, size_t begin, size_t end, size_t grain, size_t chunks):
+                body(body), begin(begin), end(end), grain(grain), chunks(chunks), next(0), done(0)
+            {}
+
+            void work(void)
+            {
+                size_t completed = 0;
+                while (true)
+                {
+                    const size_t i = next.fetch_add(1, boost::memory_order_relaxed);
+                    if (i >= chunks) break;
+                    const size_t b = begin + i*grain;
+                    try
+                    {
+                        body(b, std::min(b + grain, end));
+                    }
+                    catch (...)
+                    {
+                        gruel::scoped_lock lock(mutex);
+                        if (not error) error = boost::current_exception();
+                    }
+                    completed++;
+                }
+                if (completed == 0) return;
+                if (done.fetch_add(completed) + completed == chunks)
+                {
+                    gruel::scoped_lock lock(mutex);
+                    cond.notify_all();
+                }
+            }
+
+            void wait(void)
+            {
+                {
+                    gruel::scoped_lock lock(mutex);
+                    while (done.load() != chunks) cond.wait(lock);
+                }
+                if (error) boost::rethrow_exception(error);
+            }
+
+            Body body;
+            const size_t begin, end, grain, chunks;
+            boost::atomic<size_t> next;
+            boost::atomic<size_t> done;
+            gruel::mutex mutex;
+            gruel::condition_variable cond;
+            boost::exception_ptr error;
+        };
+
+        //! Index of the worker running on this thread, or -1
+        int current_worker(void) const
+        {
+            const boost::thread::id id = boost::this_thread::get_id();
+            for (size_t i = 0; i < d_workers.size(); i++)
+            {
+                if (d_workers[i]->id == id) return int(i);
+            }
+            return -1;
+        }
+
+        size_t next_worker(void)
+        {
+            return d_next.fetch_add(1, boost::memory_order_relaxed) % d_workers.size();
+        }
+
+        void wait_for_space(void)
+        {
+            if (pending() < d_max_queued) return;
+            gruel::scoped_lock lock(d_mutex);
+            d_blocked++;
+            while (d_pending.load() >= d_max_queued and not d_stop) d_space_cond.wait(lock);
+            d_blocked--;
+        }
+
+        void push(size_t index, const task_type &task)
+        {
+            {
+                gruel::scoped_lock lock(d_workers[index]->mutex);
+                d_workers[index]->tasks.push_back(task);
+                d_pending++;
+            }
+            //an idle worker registers before re-checking d_pending, so one side sees the other
+            if (d_idle.load() != 0)
+            {
+                gruel::scoped_lock lock(d_mutex);
+                d_work_cond.notify_one();
+            }
+        }
+
+        bool pop(size_t index, task_type &task)
+        {
+            //own deque newest first, then steal the oldest from the others
+            for (size_t k = 0; k < d_workers.size(); k++)
+            {
+                worker_t &w = *d_workers[(index + k) % d_workers.size()];
+                gruel::scoped_lock lock(w.mutex);
+                if (w.tasks.empty()) continue;
+                if (k == 0)
+                {
+                    task.swap(w.tasks.back());
+                    w.tasks.pop_back();
+                }
+                else
+                {
+                    task.swap(w.tasks.front());
+                    w.tasks.pop_front();
+                }
+                d_pending--;
+                break;
+            }
+            if (not task) return false;
+            if (d_blocked.load() != 0)
+            {
+                gruel::scoped_lock lock(d_mutex);
+                d_space_cond.notify_one();
+            }
+            return true;
+        }
+
+        static void run_task(const task_type &task)
+        {
+            try
+            {
+                task();
+            }
+            catch (...){}
+        }
+
+        void run(size_t index)
+        {
+            while (true)
+            {
+                task_type task;
+                if (pop(index, task))
+                {
+                    run_task(task);
+                    continue;
+                }
+                gruel::scoped_lock lock(d_mutex);
+                d_idle++;
+                while (d_pending.load() == 0 and not d_stop) d_work_cond.wait(lock);
+                d_idle--;
+                if (d_stop and d_pending.load() == 0) return;
+            }
+        }
+
+        const size_t d_max_queued;
+        std::vector<boost::shared_ptr<worker_t> > d_workers;
+        boost::atomic<size_t> d_pending;
+        boost::atomic<size_t> d_idle;
+        boost::atomic<size_t> d_blocked;
+        boost::atomic<size_t> d_next;
+        bool d_stop;
+        gruel::mutex d_mutex;
+        gruel::condition_variable d_work_cond;
+        gruel::condition_variable d_space_cond;
+        boost::thread_group d_threads;
+    };
+
+} //namespace gruel
+
+#endif //INCLUDED_GRUEL_THREAD_POOL_H
@@ -198,7 +198,7 @@ inline PMCC pmt_to_pmc(const pmt_t &p)
     if (is_any(p))
     {
         const boost::any a = any_ref(p);
-        if (a.type() == typeid(PMCC)) return boost::any_cast<PMCC>(a);
+        if (const PMCC *pmc = boost::any_cast<PMCC>(&a)) return *pmc;
     }
 
     //pair container